@@ -0,0 +1,941 @@
+// buffercache.cc
+//	Routines to cache disk sectors in memory.  See buffercache.h
+//	for an overview.
+//
+//	A thread that wants a sector "claims" a buffer for it: either
+//	the buffer that already holds the sector (a hit), or one taken
+//	from another sector with the clock algorithm (a miss).  Claimed
+//	buffers are pinned.  On a miss, the buffer is also marked busy
+//	until it has been filled from disk, so that any other thread
+//	that wants the same sector waits for the data to arrive rather
+//	than reading it a second time.
+//
+//	Disk I/O is always done without holding the cache lock, so that
+//	other threads can use the cache in the meantime.
+//
+//	A read-ahead claims its buffers the same way, but leaves them
+//	unpinned; they stay busy until the read-ahead thread sees the
+//	disk request finish.  A read-ahead never waits: it gives up
+//	rather than wait for a buffer, or write a dirty one back.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "buffercache.h"
+#include "synchdisk.h"
+#include "callback.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// BufferSector, HashSector
+// 	Functions needed to keep buffers in a hash table, keyed by the
+//	sector they hold.
+//----------------------------------------------------------------------
+
+static int
+BufferSector(CacheBuffer *buffer)
+{
+    return buffer->sector;
+}
+
+static unsigned
+HashSector(int sector)
+{
+    return (unsigned)sector;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize a cache with no sectors in it.
+//
+//	"numBuffers" -- number of sectors the cache can hold
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(int numBuffers)
+{
+    ASSERT(numBuffers > 0);
+    this->numBuffers = numBuffers;
+    buffers = new CacheBuffer[numBuffers];
+    for (int i = 0; i < numBuffers; i++)
+    {
+        buffers[i].sector = -1;
+        buffers[i].valid = FALSE;
+        buffers[i].dirty = FALSE;
+        buffers[i].busy = FALSE;
+        buffers[i].referenced = FALSE;
+        buffers[i].pinCount = 0;
+        buffers[i].dirtiedAt = 0;
+        buffers[i].held = FALSE;
+        buffers[i].data = new char[SectorSize];
+    }
+    hand = 0;
+    unflushed = FALSE;
+    writtenThrough = FALSE;
+    table = new HashTable<int, CacheBuffer *>(BufferSector, HashSector);
+    lock = new Lock("buffer cache");
+    changed = new Condition("buffer cache");
+    readAheads = new List<ReadAheadRequest *>;
+    readAheadsPending = new Semaphore("read-aheads", 0);
+    readAheadThread = NULL;
+    dirtySince = -1;
+    writeBehindWanted = new Semaphore("write-behind", 0);
+    writeBehindThread = NULL;
+    writeBehindPending = FALSE;
+    holder = NULL;
+    holdLimit = 0;
+    held = new CacheBuffer *[numBuffers];
+    numHeld = 0;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	De-allocate the cache.  Any dirty sectors are lost; call Sync
+//	first if they matter.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    for (int i = 0; i < numBuffers; i++) {
+        if (buffers[i].sector >= 0)
+            table->Remove(buffers[i].sector);
+        delete[] buffers[i].data;
+    }
+    delete[] buffers;
+    delete table;
+    delete lock;
+    delete changed;
+    delete readAheads;
+    delete readAheadsPending;
+    delete writeBehindWanted;
+    delete[] held;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector/WriteSector
+// 	Read/write a single sector through the cache.
+//
+//	"sector" -- the disk sector to read/write
+//	"data" -- the buffer to hold the contents of the sector, or the
+//		new contents of the sector
+//----------------------------------------------------------------------
+
+void BufferCache::ReadSector(int sector, char *data)
+{
+    ReadSectors(sector, data, 1);
+}
+
+void BufferCache::WriteSector(int sector, char *data)
+{
+    WriteSectors(sector, data, 1);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+// 	Read a run of consecutive sectors through the cache.
+//
+//	"sector" -- the first disk sector to read
+//	"data" -- buffer to hold numSectors * SectorSize bytes
+//	"numSectors" -- number of sectors to read
+//----------------------------------------------------------------------
+
+void BufferCache::ReadSectors(int sector, char *data, int numSectors)
+{
+    ReadBytes(sector, 0, data, numSectors * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadBytes
+// 	Read part of a run of consecutive sectors through the cache:
+//	"numBytes" bytes, starting "offset" bytes into the first sector.
+//	Sectors that are already cached are copied from the cache; runs
+//	of sectors that are not are read from disk with one request each,
+//	straight into their buffers.  Either way, only the bytes wanted
+//	are copied out, straight into "data".
+//
+//	The run is handled in pieces, so that no thread ever has more
+//	than a fraction of the cache pinned at once.
+//
+//	"sector" -- the first disk sector to read
+//	"offset" -- where in that sector to start
+//	"data" -- buffer to hold numBytes bytes
+//	"numBytes" -- number of bytes to read
+//----------------------------------------------------------------------
+
+void BufferCache::ReadBytes(int sector, int offset, char *data, int numBytes)
+{
+    int numSectors = divRoundUp(offset + numBytes, SectorSize);
+    int piece = max(1, numBuffers / 4);
+    CacheBuffer **claimed = new CacheBuffer *[piece];
+    bool *miss = new bool[piece];
+    int done, count, i, j, start, from, to;
+
+    ASSERT(offset >= 0 && offset < SectorSize);
+
+    for (done = 0; done < numSectors; done += count)
+    {
+        lock->Acquire();
+        for (count = 0; count < min(piece, numSectors - done); count++)
+        {
+            claimed[count] = Claim(sector + done + count, &miss[count],
+                                   count == 0);
+            if (claimed[count] == NULL)
+                break; // cache is full of pinned buffers
+        }
+        lock->Release();
+
+        for (i = 0; i < count; i = j)
+        {
+            for (j = i + 1; j < count && miss[i] && miss[j]; j++)
+                ;
+            if (miss[i])
+                Fill(&claimed[i], j - i, FALSE);
+        }
+        for (i = 0; i < count; i++)
+        { // the part of the sector that was asked for
+            start = (done + i) * SectorSize;
+            from = max(start, offset);
+            to = min(start + SectorSize, offset + numBytes);
+            bcopy(&claimed[i]->data[from - start], &data[from - offset], to - from);
+        }
+        Release(claimed, count, miss, FALSE);
+    }
+    delete[] claimed;
+    delete[] miss;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSectors
+// 	Write a run of consecutive sectors through the cache.  The new
+//	contents just replace whatever the cache has (there is no need
+//	to read the old contents of a sector that is entirely
+//	overwritten), and are written to disk later.
+//
+//	"sector" -- the first disk sector to write
+//	"data" -- numSectors * SectorSize bytes of new contents
+//	"numSectors" -- number of sectors to write
+//----------------------------------------------------------------------
+
+void BufferCache::WriteSectors(int sector, char *data, int numSectors)
+{
+    int piece = max(1, numBuffers / 4);
+    CacheBuffer **claimed = new CacheBuffer *[piece];
+    bool *miss = new bool[piece];
+    int done, count, i;
+
+    for (done = 0; done < numSectors; done += count)
+    {
+        lock->Acquire();
+        for (count = 0; count < min(piece, numSectors - done); count++)
+        {
+            claimed[count] = Claim(sector + done + count, &miss[count],
+                                   count == 0);
+            if (claimed[count] == NULL)
+                break;
+        }
+        lock->Release();
+
+        for (i = 0; i < count; i++)
+            bcopy(&data[(done + i) * SectorSize], claimed[i]->data, SectorSize);
+        Release(claimed, count, miss, TRUE);
+    }
+    delete[] claimed;
+    delete[] miss;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteThrough
+// 	Write one sector to disk now, rather than later, and leave a clean
+//	copy in the cache.  The sector is never held, even in the middle
+//	of an operation: it is for a new index block, which must be on
+//	disk before the header pointing at it is logged (see
+//	FileHeader::WriteIndex and Journal::Commit).
+//
+//	"sector" -- the disk sector to write
+//	"data" -- its new contents
+//----------------------------------------------------------------------
+
+void BufferCache::WriteThrough(int sector, char *data)
+{
+    CacheBuffer *buffer;
+    bool miss;
+
+    lock->Acquire();
+    buffer = Claim(sector, &miss, TRUE);
+    ASSERT(!buffer->held); // a new sector can't have been changed yet
+    buffer->busy = TRUE;
+    lock->Release();
+
+    bcopy(data, buffer->data, SectorSize);
+    Fill(&buffer, 1, TRUE);
+
+    lock->Acquire();
+    buffer->valid = TRUE;
+    buffer->busy = FALSE;
+    buffer->dirty = FALSE;
+    buffer->pinCount--;
+    writtenThrough = TRUE;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FlushWrittenThrough
+// 	Make sure the sectors written through since the last time have
+//	reached the disk surface, not just the disk's own cache.
+//----------------------------------------------------------------------
+
+void BufferCache::FlushWrittenThrough()
+{
+    bool flush;
+
+    lock->Acquire();
+    flush = writtenThrough;
+    writtenThrough = FALSE;
+    lock->Release();
+
+    if (flush)
+        kernel->synchDisk->Flush();
+}
+
+//----------------------------------------------------------------------
+// ReadAheadThread
+// 	Body of the read-ahead thread.  Needed because C++ can't fork
+//	a thread onto a member function.
+//----------------------------------------------------------------------
+
+static void
+ReadAheadThread(void *arg)
+{
+    ((BufferCache *)arg)->FinishReadAheads();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Start reading a run of consecutive sectors into the cache, and
+//	return without waiting for the disk.  Sectors that are already
+//	cached are skipped.  This is only a hint: if there aren't enough
+//	clean, unused buffers to hold the whole run, only part of it is
+//	read (and no more than a fraction of the cache is ever taken).
+//
+//	"sector" -- the first disk sector to read
+//	"numSectors" -- number of sectors to read
+//----------------------------------------------------------------------
+
+void BufferCache::Prefetch(int sector, int numSectors)
+{
+    CacheBuffer **run, *buffer;
+    int count = 0;
+
+    numSectors = min(numSectors, max(1, numBuffers / 4));
+    if (numSectors <= 0)
+        return;
+    run = new CacheBuffer *[numSectors];
+
+    lock->Acquire();
+    if (readAheadThread == NULL)
+    {
+        readAheadThread = new Thread("read-ahead", 1);
+        readAheadThread->Fork((VoidFunctionPtr)ReadAheadThread, (void *)this);
+    }
+    for (int i = 0; i < numSectors; i++)
+    {
+        if (table->Find(sector + i, &buffer))
+        { // already cached (or on its way); split the run here
+            StartReadAhead(run, count);
+            count = 0;
+            continue;
+        }
+        buffer = FindVictim();
+        if (buffer == NULL || buffer->dirty)
+            break;
+        if (buffer->sector >= 0)
+            table->Remove(buffer->sector);
+        buffer->sector = sector + i;
+        buffer->valid = FALSE;
+        buffer->busy = TRUE;
+        buffer->referenced = TRUE;
+        table->Insert(buffer);
+        kernel->stats->numBufferCachePrefetches++;
+        run[count++] = buffer;
+    }
+    StartReadAhead(run, count);
+    lock->Release();
+    delete[] run;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StartReadAhead
+// 	Submit a single disk request to fill some busy buffers, holding
+//	consecutive sectors, and hand it to the read-ahead thread to
+//	finish.  Must be called with the lock held.
+//
+//	"claimed" -- the buffers
+//	"count" -- how many (possibly none)
+//----------------------------------------------------------------------
+
+void BufferCache::StartReadAhead(CacheBuffer **claimed, int count)
+{
+    ReadAheadRequest *readAhead;
+
+    if (count == 0)
+        return;
+    DEBUG(dbgFile, "Reading ahead " << count << " sectors at " << claimed[0]->sector);
+    readAhead = new ReadAheadRequest;
+    readAhead->buffers = new CacheBuffer *[count];
+    readAhead->data = new char *[count];
+    readAhead->count = count;
+    for (int i = 0; i < count; i++)
+    {
+        readAhead->buffers[i] = claimed[i];
+        readAhead->data[i] = claimed[i]->data;
+    }
+    readAhead->request = new DiskRequest(claimed[0]->sector, readAhead->data,
+                                         count, FALSE);
+    kernel->synchDisk->Submit(readAhead->request);
+    readAheads->Append(readAhead);
+    readAheadsPending->V();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FinishReadAheads
+// 	Loop forever, waiting for each read-ahead to come back from disk,
+//	and then letting threads at the buffers it filled.  Run by the
+//	read-ahead thread.
+//----------------------------------------------------------------------
+
+void BufferCache::FinishReadAheads()
+{
+    for (;;)
+    {
+        readAheadsPending->P();
+        ReadAheadRequest *readAhead = readAheads->RemoveFront();
+
+        readAhead->request->Wait();
+        lock->Acquire();
+        for (int i = 0; i < readAhead->count; i++)
+        {
+            readAhead->buffers[i]->valid = TRUE;
+            readAhead->buffers[i]->busy = FALSE;
+        }
+        changed->Broadcast(lock);
+        lock->Release();
+
+        delete readAhead->request;
+        delete[] readAhead->buffers;
+        delete[] readAhead->data;
+        delete readAhead;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Pin
+// 	Return the buffer holding "sector", pinned so that it stays put
+//	until the caller calls Unpin.  The caller may read or modify the
+//	buffer's data in the meantime.
+//
+//	"sector" -- the disk sector wanted
+//	"willOverwrite" -- TRUE if the caller is about to replace the
+//		whole sector, so there is no need to read it from disk
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Pin(int sector, bool willOverwrite)
+{
+    CacheBuffer *buffer;
+    bool miss;
+
+    lock->Acquire();
+    buffer = Claim(sector, &miss, TRUE);
+    lock->Release();
+    if (miss && !willOverwrite)
+    {
+        Fill(&buffer, 1, FALSE);
+        lock->Acquire();
+        buffer->valid = TRUE; // let other threads at it
+        buffer->busy = FALSE;
+        changed->Broadcast(lock);
+        lock->Release();
+    }
+    return buffer;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Unpin
+// 	Release a buffer returned by Pin.
+//
+//	"buffer" -- the buffer
+//	"dirty" -- TRUE if the caller modified the buffer's data
+//----------------------------------------------------------------------
+
+void BufferCache::Unpin(CacheBuffer *buffer, bool dirty)
+{
+    bool miss = !buffer->valid; // pinned to be overwritten
+
+    Release(&buffer, 1, &miss, dirty);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::HoldChanges
+// 	From now on, hold every sector the current thread changes: keep it
+//	in the cache, and don't write it back, until ReleaseHeld.  Used by
+//	the journal, to keep a transaction off the disk until it has been
+//	committed.  Sectors held for earlier threads (that are part of the
+//	same transaction) stay held too.
+//
+//	The journal makes sure that no more than "limit" sectors (counting
+//	those held already) are ever held, by committing before the thread
+//	starts; it may not ask for more than half the cache, so that there
+//	are always buffers left over for everything else.
+//
+//	"limit" -- the most sectors that may be held
+//----------------------------------------------------------------------
+
+void BufferCache::HoldChanges(int limit)
+{
+    lock->Acquire();
+    ASSERT(holder == NULL && limit <= numBuffers / 2);
+    holder = kernel->currentThread;
+    holdLimit = limit;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CopyHeld
+// 	Copy out the sectors being held, and return how many there are.
+//
+//	"sectors" -- set to their sector numbers
+//	"data" -- set to their contents, one after another
+//----------------------------------------------------------------------
+
+int BufferCache::CopyHeld(int *sectors, char *data)
+{
+    lock->Acquire();
+    for (int i = 0; i < numHeld; i++)
+    {
+        sectors[i] = held[i]->sector;
+        bcopy(held[i]->data, &data[i * SectorSize], SectorSize);
+    }
+    lock->Release();
+    return numHeld;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReleaseHeld
+// 	Let the sectors being held be written back, like any other dirty
+//	sector.  Changes made from now on are still held.
+//----------------------------------------------------------------------
+
+void BufferCache::ReleaseHeld()
+{
+    lock->Acquire();
+    for (int i = 0; i < numHeld; i++)
+    {
+        held[i]->held = FALSE;
+        held[i]->dirtiedAt = kernel->stats->totalTicks;
+        if (dirtySince < 0)
+            dirtySince = held[i]->dirtiedAt;
+    }
+    numHeld = 0;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StopHolding
+// 	Stop holding the changes of the thread that called HoldChanges.
+//	The sectors it changed stay held until ReleaseHeld.
+//----------------------------------------------------------------------
+
+void BufferCache::StopHolding()
+{
+    lock->Acquire();
+    holder = NULL;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Sync
+// 	Write every dirty sector in the cache back to disk, and then make
+//	sure the disk itself has them (see SynchDisk::Flush).
+//
+//	Sectors that are dirtied while the Sync is in progress may or may
+//	not be written.
+//----------------------------------------------------------------------
+
+void BufferCache::Sync()
+{
+    bool flush;
+
+    WriteBack(TRUE);
+    lock->Acquire();
+    flush = unflushed;
+    unflushed = FALSE;
+    lock->Release();
+
+    if (flush)
+        kernel->synchDisk->Flush();
+}
+
+//----------------------------------------------------------------------
+// WriteBehindThread
+// 	Body of the write-behind thread.  Needed because C++ can't fork
+//	a thread onto a member function.
+//----------------------------------------------------------------------
+
+static void
+WriteBehindThread(void *arg)
+{
+    ((BufferCache *)arg)->WriteBehind();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBehind
+// 	Loop forever, writing back the sectors that have been dirty for
+//	more than WriteBehindDelay ticks, whenever CheckWriteBehind asks.
+//	Run by the write-behind thread.
+//----------------------------------------------------------------------
+
+void BufferCache::WriteBehind()
+{
+    for (;;)
+    {
+        writeBehindWanted->P();
+        WriteBack(FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CheckWriteBehind
+// 	Wake up the write-behind thread if some sector has been dirty for
+//	too long.  Must be called with the lock held.
+//
+//	Nachos has no way for a thread to sleep for a while, so instead
+//	of running off a timer, this is checked every time the cache is
+//	used.
+//----------------------------------------------------------------------
+
+void BufferCache::CheckWriteBehind()
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    if (dirtySince < 0 || writeBehindPending ||
+        kernel->stats->totalTicks - dirtySince < WriteBehindDelay)
+        return;
+    if (writeBehindThread == NULL)
+    {
+        writeBehindThread = new Thread("write-behind", 1);
+        writeBehindThread->Fork((VoidFunctionPtr)WriteBehindThread, (void *)this);
+    }
+    writeBehindPending = TRUE;
+    writeBehindWanted->V();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBack
+// 	Write dirty sectors back to disk, merging consecutive sectors
+//	into single requests.
+//
+//	"all" -- TRUE to write every dirty sector, waiting for any that
+//		are in use; FALSE to write only those that have been dirty
+//		for WriteBehindDelay ticks, and that nobody is using
+//----------------------------------------------------------------------
+
+void BufferCache::WriteBack(bool all)
+{
+    CacheBuffer **dirty = new CacheBuffer *[numBuffers];
+    int expired = kernel->stats->totalTicks - WriteBehindDelay;
+    int count, i, j;
+
+    lock->Acquire();
+    do
+    { // collect the dirty buffers, waiting until nobody is using them
+        count = 0;
+        for (i = 0; i < numBuffers; i++)
+        {
+            if (!buffers[i].dirty || buffers[i].held ||
+                (!all && buffers[i].dirtiedAt > expired))
+                continue;
+            if (buffers[i].busy || buffers[i].pinCount > 0)
+            {
+                if (all)
+                    break;
+                continue;
+            }
+            dirty[count++] = &buffers[i];
+        }
+        if (i < numBuffers)
+            changed->Wait(lock);
+    } while (i < numBuffers);
+
+    for (i = 1; i < count; i++) // sort by sector number
+    {
+        CacheBuffer *buffer = dirty[i];
+
+        for (j = i; j > 0 && dirty[j - 1]->sector > buffer->sector; j--)
+            dirty[j] = dirty[j - 1];
+        dirty[j] = buffer;
+    }
+    for (i = 0; i < count; i++)
+        dirty[i]->busy = TRUE;
+    lock->Release();
+
+    DEBUG(dbgFile, "Writing back " << count << " dirty sectors");
+    for (i = 0; i < count; i = j)
+    {
+        for (j = i + 1; j < count && dirty[j]->sector == dirty[i]->sector + (j - i); j++)
+            ;
+        Fill(&dirty[i], j - i, TRUE);
+    }
+
+    lock->Acquire();
+    for (i = 0; i < count; i++)
+    {
+        dirty[i]->dirty = FALSE;
+        dirty[i]->busy = FALSE;
+    }
+    dirtySince = -1; // find the oldest sector still dirty
+    for (i = 0; i < numBuffers; i++)
+        if (buffers[i].dirty && !buffers[i].held &&
+            (dirtySince < 0 || buffers[i].dirtiedAt < dirtySince))
+            dirtySince = buffers[i].dirtiedAt;
+    if (!all)
+        writeBehindPending = FALSE;
+    changed->Broadcast(lock);
+    lock->Release();
+    delete[] dirty;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Claim
+// 	Return a pinned buffer for "sector".  Must be called with the
+//	lock held; the lock may be released and re-acquired along the way.
+//
+//	If the sector is already cached, return its buffer (waiting for
+//	it if it is busy).  That counts as a hit in the statistics, unless
+//	the sector was still on its way in from disk (eg, being read
+//	ahead).  Otherwise, take a buffer away from some other
+//	sector, writing the old contents back to disk first if they are
+//	dirty.  The new buffer is returned busy and not yet valid, and
+//	*miss is set; the caller must fill it, and then Release it.
+//
+//	If there is no buffer that can be taken (they are all pinned),
+//	either wait for one, or, if "mayWait" is FALSE (because the
+//	caller already has buffers pinned, and waiting might deadlock),
+//	return NULL.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Claim(int sector, bool *miss, bool mayWait)
+{
+    CacheBuffer *buffer;
+    bool arriving = FALSE; // did we wait for it to be read in?
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    CheckWriteBehind();
+    for (;;)
+    {
+        if (table->Find(sector, &buffer))
+        {
+            if (buffer->busy)
+            { // somebody else is reading it in, or writing it out
+                if (!buffer->valid)
+                    arriving = TRUE;
+                changed->Wait(lock);
+                continue;
+            }
+            buffer->pinCount++;
+            buffer->referenced = TRUE;
+            if (arriving)
+                kernel->stats->numBufferCacheMisses++;
+            else
+                kernel->stats->numBufferCacheHits++;
+            *miss = FALSE;
+            return buffer;
+        }
+
+        buffer = FindVictim();
+        if (buffer == NULL)
+        {
+            if (!mayWait)
+                return NULL;
+            changed->Wait(lock);
+            continue;
+        }
+        if (buffer->dirty)
+        { // write back the old contents, then start over, since
+          // the cache may have changed while we were waiting
+            CacheBuffer **run = new CacheBuffer *[numBuffers];
+            int count = Cluster(buffer, run);
+
+            lock->Release();
+            Fill(run, count, TRUE);
+            lock->Acquire();
+            for (int i = 0; i < count; i++)
+            {
+                run[i]->dirty = FALSE;
+                run[i]->busy = FALSE;
+            }
+            delete[] run;
+            changed->Broadcast(lock);
+            continue;
+        }
+
+        if (buffer->sector >= 0)
+            table->Remove(buffer->sector);
+        buffer->sector = sector;
+        buffer->valid = FALSE;
+        buffer->busy = TRUE;
+        buffer->referenced = TRUE;
+        buffer->pinCount = 1;
+        table->Insert(buffer);
+        kernel->stats->numBufferCacheMisses++;
+        *miss = TRUE;
+        return buffer;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FindVictim
+// 	Choose a buffer to hold a new sector, with the clock algorithm:
+//	sweep around the buffers, skipping any that are in use, and
+//	giving those that have been used recently a second chance.
+//	Return NULL if every buffer is in use.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::FindVictim()
+{
+    for (int i = 0; i < 2 * numBuffers; i++)
+    {
+        CacheBuffer *buffer = &buffers[hand];
+
+        hand = (hand + 1) % numBuffers;
+        if (buffer->busy || buffer->pinCount > 0 || buffer->held)
+            continue;
+        if (buffer->referenced)
+        {
+            buffer->referenced = FALSE;
+            continue;
+        }
+        return buffer;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Cluster
+// 	Collect a dirty buffer that is about to be written back, together
+//	with the dirty buffers for the sectors on either side of it that
+//	nobody is using, so that they can all go to disk in one request.
+//	A file written sequentially is then written back a run at a time,
+//	rather than a sector at a time as each buffer is replaced.
+//
+//	The buffers are marked busy.  Must be called with the lock held.
+//
+//	"victim" -- the dirty buffer
+//	"run" -- array to hold the buffers, in sector order
+//
+//	Returns the number of buffers in the run.
+//----------------------------------------------------------------------
+
+int BufferCache::Cluster(CacheBuffer *victim, CacheBuffer **run)
+{
+    int limit = max(1, numBuffers / 4);
+    int first = victim->sector, last = victim->sector;
+    CacheBuffer *buffer;
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    while (last - first + 1 < limit && table->Find(first - 1, &buffer) &&
+           buffer->dirty && !buffer->busy && buffer->pinCount == 0 &&
+           !buffer->held)
+        first--;
+    while (last - first + 1 < limit && table->Find(last + 1, &buffer) &&
+           buffer->dirty && !buffer->busy && buffer->pinCount == 0 &&
+           !buffer->held)
+        last++;
+
+    for (int sector = first; sector <= last; sector++)
+    {
+        table->Find(sector, &buffer);
+        buffer->busy = TRUE;
+        run[sector - first] = buffer;
+    }
+    return last - first + 1;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Fill
+// 	Transfer the data of some buffers, holding consecutive sectors,
+//	to or from disk with a single request.  Called without the lock
+//	held; the buffers must be busy, so no one else touches them.
+//
+//	"claimed" -- the buffers
+//	"count" -- how many
+//	"writing" -- TRUE to write the buffers to disk, FALSE to read
+//----------------------------------------------------------------------
+
+void BufferCache::Fill(CacheBuffer **claimed, int count, bool writing)
+{
+    char **data = new char *[count];
+
+    for (int i = 0; i < count; i++)
+    {
+        ASSERT(claimed[i]->busy && claimed[i]->sector == claimed[0]->sector + i);
+        data[i] = claimed[i]->data;
+    }
+    DiskRequest request(claimed[0]->sector, data, count, writing);
+    kernel->synchDisk->Submit(&request);
+    request.Wait();
+    delete[] data;
+    if (writing)
+        unflushed = TRUE;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Release
+// 	Unpin buffers returned by Claim.  Buffers that were claimed on a
+//	miss now hold valid data, and other threads may use them.
+//
+//	"claimed" -- the buffers
+//	"count" -- how many
+//	"miss" -- which of them were misses
+//	"dirty" -- TRUE if the caller modified the buffers
+//----------------------------------------------------------------------
+
+void BufferCache::Release(CacheBuffer **claimed, int count, bool *miss,
+                          bool dirty)
+{
+    bool holding = dirty && holder == kernel->currentThread;
+
+    lock->Acquire();
+    for (int i = 0; i < count; i++)
+    {
+        if (miss[i])
+        {
+            claimed[i]->valid = TRUE;
+            claimed[i]->busy = FALSE;
+        }
+        if (holding)
+        { // not to be written back until the journal says so
+            if (!claimed[i]->held)
+            {
+                claimed[i]->held = TRUE;
+                held[numHeld++] = claimed[i];
+                ASSERT(numHeld <= holdLimit); // see HoldChanges
+            }
+            claimed[i]->dirty = TRUE;
+        }
+        else if (dirty && !claimed[i]->dirty)
+        {
+            claimed[i]->dirty = TRUE;
+            claimed[i]->dirtiedAt = kernel->stats->totalTicks;
+            if (dirtySince < 0)
+                dirtySince = claimed[i]->dirtiedAt;
+        }
+        claimed[i]->pinCount--;
+    }
+    CheckWriteBehind();
+    changed->Broadcast(lock);
+    lock->Release();
+}
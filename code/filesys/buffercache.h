@@ -0,0 +1,194 @@
+// buffercache.h
+//	Data structures for caching disk sectors in memory, in front of
+//	the synchronous disk.
+//
+//	All file system I/O (file headers, directories, the free map,
+//	and file data) goes through the cache, so a sector that is used
+//	over and over -- eg, the root directory -- is read from disk
+//	only once.  Writes are also absorbed by the cache: a dirty
+//	sector is written back only when its buffer is needed for some
+//	other sector, when it has been dirty for a while (see
+//	WriteBehindDelay), or when the file system asks for a Sync().
+//
+//	The cache is a fixed number of sector-sized buffers, replaced
+//	with the clock algorithm.  A buffer is "pinned" while a thread
+//	is using it, so it can't be replaced underneath; it is "busy"
+//	while its contents are being read from or written to disk, and
+//	any other thread that wants it waits.
+//
+//	Sectors can also be read ahead of time: Prefetch starts reading
+//	them into the cache and returns at once, and a "read-ahead"
+//	thread marks the buffers valid when the disk is done.  A thread
+//	that wants one of the sectors before then just waits for it, as
+//	for any other busy buffer.
+//
+//	For the journal, the cache can also "hold" the sectors that one
+//	thread changes: they are not written back, or replaced, until
+//	the journal has logged them and lets go (see journal.h).  A
+//	sector that must not wait for that -- a new index block -- can be
+//	written through to the disk instead.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "synch.h"
+#include "hash.h"
+#include "list.h"
+
+class DiskRequest;
+class Thread;
+
+const int DefaultCacheBuffers = 64; // size of the cache, unless set
+                                    // on the command line
+const int MinCacheBuffers = 32;     // ... but no smaller; the journal
+                                    // needs room for a transaction
+const int WriteBehindDelay = 20000; // ticks a sector may stay dirty
+                                    // before it is written behind
+
+// The following class holds one cached sector.
+
+class CacheBuffer
+{
+public:
+    int sector;       // Which sector is cached here, -1 if none
+    bool valid;       // Does "data" hold the sector's contents?
+    bool dirty;       // Has "data" been changed since it was
+                      // last written to disk?
+    bool busy;        // Is the buffer being read or written?
+    bool referenced;  // Used since the clock hand last passed?
+    int pinCount;     // Number of threads using the buffer
+    int dirtiedAt;    // When "dirty" was last set
+    bool held;        // Changed by a transaction that the journal
+                      // has not committed yet?
+    char *data;       // The contents of the sector
+};
+
+// The following class records a read-ahead that is in progress.
+
+class ReadAheadRequest
+{
+public:
+    DiskRequest *request;   // The disk request reading the sectors
+    CacheBuffer **buffers;  // The buffers being filled
+    char **data;            // Their data, as handed to the disk
+    int count;              // Number of buffers
+};
+
+// The following class defines the cache itself.
+
+class BufferCache
+{
+public:
+    BufferCache(int numBuffers); // Initialize an empty cache
+    ~BufferCache();              // De-allocate the cache; it had
+                                 // better have been Sync'ed
+
+    void ReadSector(int sector, char *data);
+    void WriteSector(int sector, char *data);
+    // Read/write one sector, through
+    // the cache
+    void ReadSectors(int sector, char *data, int numSectors);
+    void WriteSectors(int sector, char *data, int numSectors);
+    // Same, for a run of consecutive
+    // sectors; sectors that are not
+    // cached are read with as few disk
+    // requests as possible
+    void ReadBytes(int sector, int offset, char *data, int numBytes);
+    // Read part of such a run, copying
+    // only the bytes asked for
+    void WriteThrough(int sector, char *data);
+    // Write one sector to disk now,
+    // keeping a copy in the cache
+    void FlushWrittenThrough();
+    // Make sure the disk itself has the
+    // sectors written through so far
+
+    void Prefetch(int sector, int numSectors);
+    // Start reading a run of consecutive
+    // sectors into the cache, without
+    // waiting for them
+    void FinishReadAheads();
+    // Body of the read-ahead thread
+
+    CacheBuffer *Pin(int sector, bool willOverwrite);
+    // Return the buffer for "sector",
+    // pinned, reading it in unless the
+    // caller is going to overwrite
+    // all of it
+    void Unpin(CacheBuffer *buffer, bool dirty);
+    // Done with a pinned buffer; "dirty"
+    // if the caller changed it
+
+    void HoldChanges(int limit);
+    // Hold the sectors the current thread
+    // changes from now on, up to "limit"
+    int CopyHeld(int *sectors, char *data);
+    // Copy out the sectors held, and
+    // their contents; return how many
+    void ReleaseHeld(); // Let them be written back now
+    void StopHolding(); // Stop holding the current thread's
+                        // changes (those held stay held)
+    int NumHeld() { return numHeld; } // Number of sectors held
+    int NumBuffers() { return numBuffers; } // Size of the cache
+
+    void Sync(); // Write every dirty sector back to
+                 // disk, and flush the disk
+    void WriteBehind(); // Body of the write-behind thread
+
+private:
+    CacheBuffer *Claim(int sector, bool *miss, bool mayWait);
+    // Find or make a buffer for a sector
+    CacheBuffer *FindVictim(); // Choose a buffer to re-use
+    int Cluster(CacheBuffer *victim, CacheBuffer **run);
+    // Gather dirty neighbours of a
+    // buffer to write back with it
+    void Fill(CacheBuffer **buffers, int count, bool writing);
+    // Transfer consecutive buffers to
+    // or from disk, as one request
+    void Release(CacheBuffer **buffers, int count, bool *miss,
+                 bool dirty);
+    // Unpin buffers claimed for a transfer
+    void WriteBack(bool all); // Write dirty sectors to disk
+    void CheckWriteBehind();  // Start the write-behind thread,
+                              // if it is time
+    void StartReadAhead(CacheBuffer **buffers, int count);
+    // Submit the disk request for a
+    // run of prefetched buffers
+
+    int numBuffers;      // Number of buffers in the cache
+    CacheBuffer *buffers; // The buffers themselves
+    int hand;            // Position of the clock hand
+    bool unflushed;      // Written to the disk since it was
+                         // last flushed?
+    bool writtenThrough; // Written through since then?
+    HashTable<int, CacheBuffer *> *table; // Buffers in use, by sector
+    Lock *lock;          // Protects all of the above
+    Condition *changed;  // Signalled when a buffer stops being
+                         // busy or pinned
+
+    List<ReadAheadRequest *> *readAheads; // Read-aheads submitted
+                                   // to the disk, oldest first
+    Semaphore *readAheadsPending;  // Number of entries in readAheads
+    Thread *readAheadThread;       // Thread that completes them,
+                                   // NULL until the first Prefetch
+
+    int dirtySince;                // When the oldest dirty sector was
+                                   // dirtied, -1 if none are
+    Semaphore *writeBehindWanted;  // Wakes up the write-behind thread
+    Thread *writeBehindThread;     // NULL until it is first needed
+    bool writeBehindPending;       // Has it been woken up already?
+
+    Thread *holder;                // Thread whose changes are held,
+                                   // NULL if none
+    int holdLimit;                 // Most it may hold
+    CacheBuffer **held;            // The buffers held
+    int numHeld;                   // How many there are
+};
+
+#endif // BUFFERCACHE_H
@@ -0,0 +1,190 @@
+// dentrycache.cc
+//	Routines to cache the results of name lookups.  See dentrycache.h
+//	for an overview.
+//
+//	Entries are found through a hash table on (directory, name),
+//	chained through the entries themselves.  When the cache is full,
+//	the clock hand picks an entry that hasn't been used lately, and
+//	it is re-used for the new name.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dentrycache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize a cache with no names in it.
+//
+//	"numEntries" -- number of names the cache can hold
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache(int numEntries)
+{
+    ASSERT(numEntries > 0);
+    this->numEntries = numEntries;
+    entries = new Dentry[numEntries];
+    buckets = new int[numEntries];
+    for (int i = 0; i < numEntries; i++)
+    {
+        entries[i].parent = -1;
+        entries[i].name = NULL;
+    }
+    Purge();
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    Purge();
+    delete[] entries;
+    delete[] buckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::HashValue
+// 	Return which hash chain the entry for "name" in directory "parent"
+//	is on.
+//----------------------------------------------------------------------
+
+unsigned DentryCache::HashValue(int parent, char *name)
+{
+    unsigned hash = 2166136261u ^ (unsigned)parent;
+
+    for (; *name != '\0'; name++)
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash % numEntries;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Find
+// 	Return the index of the entry for "name" in directory "parent",
+//	or -1 if it isn't cached.
+//----------------------------------------------------------------------
+
+int DentryCache::Find(int parent, char *name)
+{
+    int i;
+
+    for (i = buckets[HashValue(parent, name)]; i != -1; i = entries[i].next)
+        if (entries[i].parent == parent && !strcmp(entries[i].name, name))
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unhash
+// 	Take entry "i" off its hash chain, and mark it unused.
+//----------------------------------------------------------------------
+
+void DentryCache::Unhash(int i)
+{
+    int *link = &buckets[HashValue(entries[i].parent, entries[i].name)];
+
+    while (*link != i)
+    {
+        ASSERT(*link != -1);
+        link = &entries[*link].next;
+    }
+    *link = entries[i].next;
+    entries[i].parent = -1;
+    delete[] entries[i].name;
+    entries[i].name = NULL;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look for "name" in directory "parent".  Return FALSE if the cache
+//	doesn't know about it; otherwise return TRUE, along with the
+//	sector of its file header (-1 if there is no such file), and
+//	whether it is a directory.
+//
+//	"parent" -- sector of the directory's file header
+//	"name" -- the name to look up
+//	"sector", "isDir" -- set to what the name refers to
+//----------------------------------------------------------------------
+
+bool DentryCache::Lookup(int parent, char *name, int *sector, bool *isDir)
+{
+    int i = Find(parent, name);
+
+    if (i == -1)
+    {
+        kernel->stats->numDentryCacheMisses++;
+        return FALSE;
+    }
+    kernel->stats->numDentryCacheHits++;
+    entries[i].referenced = TRUE;
+    *sector = entries[i].sector;
+    *isDir = entries[i].isDir;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember what "name" in directory "parent" refers to, replacing
+//	whatever the cache knew about it before.
+//
+//	"parent" -- sector of the directory's file header
+//	"name" -- the name
+//	"sector" -- sector of its file header, or -1 if there is no such
+//		file
+//	"isDir" -- is it a directory?
+//----------------------------------------------------------------------
+
+void DentryCache::Enter(int parent, char *name, int sector, bool isDir)
+{
+    int i = Find(parent, name);
+    unsigned bucket;
+
+    if (i == -1)
+    { // pick an entry to re-use
+        while (entries[hand].parent != -1 && entries[hand].referenced)
+        {
+            entries[hand].referenced = FALSE;
+            hand = (hand + 1) % numEntries;
+        }
+        i = hand;
+        hand = (hand + 1) % numEntries;
+        if (entries[i].parent != -1)
+            Unhash(i);
+
+        entries[i].parent = parent;
+        entries[i].name = new char[strlen(name) + 1];
+        strcpy(entries[i].name, name);
+        bucket = HashValue(parent, name);
+        entries[i].next = buckets[bucket];
+        buckets[bucket] = i;
+    }
+    DEBUG(dbgFile, "Dentry cache: " << parent << "/" << name << " -> " << sector);
+    entries[i].sector = sector;
+    entries[i].isDir = isDir;
+    entries[i].referenced = TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Purge
+// 	Forget every name.  Used when a directory is removed, since its
+//	header sector may later be re-used for another directory, and
+//	any names cached for it would then be wrong.
+//----------------------------------------------------------------------
+
+void DentryCache::Purge()
+{
+    for (int i = 0; i < numEntries; i++)
+    {
+        delete[] entries[i].name;
+        entries[i].name = NULL;
+        entries[i].parent = -1;
+        entries[i].referenced = FALSE;
+        buckets[i] = -1;
+    }
+    hand = 0;
+}
@@ -0,0 +1,77 @@
+// dentrycache.h
+//	Data structures for caching the results of looking up names in
+//	directories.
+//
+//	Resolving a path name means looking up each of its components in
+//	the directory named by the one before.  Without a cache, each
+//	step reads the directory's file header and contents from disk
+//	(or at least from the buffer cache).  The dentry ("directory
+//	entry") cache remembers, for a directory and a name, which file
+//	header the name refers to, and whether it is a directory -- or
+//	that the name is not there at all (a "negative" entry), so that
+//	looking for files that don't exist is cheap too.
+//
+//	The file system keeps the cache up to date: it enters a name when
+//	it creates a file, and marks it absent when it removes one.
+//
+//	The cache holds a fixed number of entries, replaced with the
+//	clock algorithm.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DENTRYCACHE_H
+#define DENTRYCACHE_H
+
+#include "copyright.h"
+
+const int DentryCacheSize = 128; // number of names cached
+
+// The following class holds one cached name.
+
+class Dentry
+{
+public:
+    int parent;      // Sector of the directory's file header,
+                     // -1 if the entry is unused
+    char *name;      // Name looked up in it
+    int sector;      // Sector of the file header for "name",
+                     // -1 if there is no such file
+    bool isDir;      // Is "name" a directory?
+    bool referenced; // Used since the clock hand last passed?
+    int next;        // Next entry in the same hash chain, -1 if none
+};
+
+// The following class defines the cache itself.
+
+class DentryCache
+{
+public:
+    DentryCache(int numEntries); // Initialize an empty cache
+    ~DentryCache();              // De-allocate the cache
+
+    bool Lookup(int parent, char *name, int *sector, bool *isDir);
+    // Is "name" in directory "parent"
+    // cached?  If so, return its header
+    // sector (-1 if it is known not to
+    // exist) and whether it's a directory
+    void Enter(int parent, char *name, int sector, bool isDir);
+    // Remember what "name" refers to;
+    // "sector" is -1 if it doesn't exist
+    void Purge(); // Forget everything, eg, when a
+                  // directory is removed
+
+private:
+    int Find(int parent, char *name); // Index of the entry, or -1
+    void Unhash(int i);               // Take entry "i" out of its chain
+    unsigned HashValue(int parent, char *name);
+
+    int numEntries;    // Number of entries in the cache
+    Dentry *entries;   // The entries themselves
+    int *buckets;      // For each hash value, the first entry in its
+                       // chain, -1 if none
+    int hand;          // Position of the clock hand
+};
+
+#endif // DENTRYCACHE_H
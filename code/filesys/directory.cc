@@ -1,19 +1,19 @@
 // directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a table of entries; each entry represents a
+//	single file, and contains the file name, and the location of the
+//	file header on disk.  On disk, each entry is a variable length
+//	record, so that names can be long without wasting space on short
+//	ones.  In memory, the entries are indexed by a hash table, so that
+//	a name can be found without looking at every entry.
 //
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	The directory file grows as entries are added; the record of a
+//	removed entry is re-used for a later name that fits in it.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -25,6 +25,46 @@
 #include "filehdr.h"
 #include "directory.h"
 #include "filesys.h"
+#include "inodetable.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// RecordLength
+// 	Return the number of bytes a record for a name of "nameLength"
+//	characters takes in the directory file.
+//----------------------------------------------------------------------
+
+static int
+RecordLength(int nameLength)
+{
+    return divRoundUp(sizeof(DirectoryRecord) + nameLength, sizeof(int)) * sizeof(int);
+}
+
+//----------------------------------------------------------------------
+// FreeList
+// 	Return which free list a record of "length" bytes goes on.
+//----------------------------------------------------------------------
+
+static int
+FreeList(int length)
+{
+    return min(length / (int)sizeof(int), (int)NumFreeLists - 1);
+}
+
+//----------------------------------------------------------------------
+// HashName
+// 	Return a hash value for a file name (FNV-1a).
+//----------------------------------------------------------------------
+
+static unsigned
+HashName(char *name)
+{
+    unsigned hash = 2166136261u;
+
+    for (; *name != '\0'; name++)
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash;
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -33,19 +73,20 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries to make room for; the table grows
+//	if more are needed
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
-
-    // MP4 mod tag
-    memset(table, 0, sizeof(DirectoryEntry) * size); // dummy operation to keep valgrind happy
-
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+    maxEntries = max(size, 1);
+    table = new DirectoryEntry[maxEntries];
+    numBuckets = 16;
+    while (numBuckets < maxEntries)
+        numBuckets *= 2;
+    buckets = new int[numBuckets];
+    tableSize = 0;
+    Clear();
 }
 
 //----------------------------------------------------------------------
@@ -55,7 +96,27 @@ Directory::Directory(int size)
 
 Directory::~Directory()
 {
+    Clear();
     delete[] table;
+    delete[] buckets;
+}
+
+//----------------------------------------------------------------------
+// Directory::Clear
+// 	Forget all the entries, leaving an empty directory.
+//----------------------------------------------------------------------
+
+void Directory::Clear()
+{
+    for (int i = 0; i < tableSize; i++)
+        delete[] table[i].name;
+    for (int i = 0; i < numBuckets; i++)
+        buckets[i] = -1;
+    for (int i = 0; i < (int)NumFreeLists; i++)
+        freeLists[i] = -1;
+    tableSize = 0;
+    numInUse = 0;
+    fileLength = 0;
 }
 
 //----------------------------------------------------------------------
@@ -67,19 +128,176 @@ Directory::~Directory()
 
 void Directory::FetchFrom(OpenFile *file)
 {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int length = file->Length();
+    char *buf = new char[length];
+    DirectoryRecord record;
+    DirectoryEntry *entry;
+    int offset, i;
+
+    Clear();
+    (void)file->ReadAt(buf, length, 0);
+    for (offset = 0; offset + (int)sizeof(DirectoryRecord) <= length; offset += record.length)
+    {
+        bcopy(&buf[offset], (char *)&record, sizeof(DirectoryRecord));
+        if (record.length < RecordLength(record.nameLength) ||
+            offset + record.length > length)
+            break; // not a record; the rest of the file is unused
+
+        i = NewEntry(); // may move the table
+        entry = &table[i];
+        entry->offset = offset;
+        entry->length = record.length;
+        entry->sector = record.sector;
+        entry->isDir = record.isDir;
+        if (record.sector == -1)
+            AddFree(i);
+        else
+        {
+            entry->inUse = TRUE;
+            entry->name = new char[record.nameLength + 1];
+            bcopy(&buf[offset + sizeof(DirectoryRecord)], entry->name, record.nameLength);
+            entry->name[record.nameLength] = '\0';
+            Hash(i);
+        }
+    }
+    fileLength = offset;
+    delete[] buf;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  Only the
+//	entries that were changed are written (runs of them together), so
+//	adding or removing a file dirties just the sector holding its entry.
+//	New entries are appended to the file, which grows to hold them.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void Directory::WriteBack(OpenFile *file)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DirectoryRecord record;
+    char *buf;
+    int i, j, k;
+
+    for (i = 0; i < tableSize; i = j)
+    {
+        if (!table[i].dirty)
+        {
+            j = i + 1;
+            continue;
+        }
+        for (j = i; j < tableSize && table[j].dirty; j++)
+            ;
+        // entries are in file order, so the run is contiguous on disk
+        buf = new char[table[j - 1].offset + table[j - 1].length - table[i].offset];
+        bzero(buf, table[j - 1].offset + table[j - 1].length - table[i].offset);
+        for (k = i; k < j; k++)
+        {
+            char *at = &buf[table[k].offset - table[i].offset];
+
+            record.sector = table[k].inUse ? table[k].sector : -1;
+            record.length = table[k].length;
+            record.nameLength = table[k].inUse ? strlen(table[k].name) : 0;
+            record.isDir = table[k].isDir;
+            bcopy((char *)&record, at, sizeof(DirectoryRecord));
+            if (table[k].inUse)
+                bcopy(table[k].name, at + sizeof(DirectoryRecord), record.nameLength);
+            table[k].dirty = FALSE;
+        }
+        (void)file->WriteAt(buf, table[j - 1].offset + table[j - 1].length - table[i].offset,
+                            table[i].offset);
+        delete[] buf;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::NewEntry
+// 	Add an entry, not in use, to the end of the table, growing the
+//	table if need be, and return its index.
+//----------------------------------------------------------------------
+
+int Directory::NewEntry()
+{
+    DirectoryEntry *entry;
+
+    if (tableSize == maxEntries)
+    {
+        DirectoryEntry *oldTable = table;
+
+        maxEntries *= 2;
+        table = new DirectoryEntry[maxEntries];
+        bcopy((char *)oldTable, (char *)table, tableSize * sizeof(DirectoryEntry));
+        delete[] oldTable;
+    }
+    entry = &table[tableSize];
+    entry->inUse = FALSE;
+    entry->sector = -1;
+    entry->name = NULL;
+    entry->isDir = FALSE;
+    entry->next = -1;
+    entry->dirty = FALSE;
+    return tableSize++;
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Put entry "i" into the hash table, first doubling the number of
+//	buckets if the chains are getting long.
+//----------------------------------------------------------------------
+
+void Directory::Hash(int i)
+{
+    int bucket;
+
+    if (numInUse >= 2 * numBuckets)
+    {
+        delete[] buckets;
+        numBuckets *= 2;
+        buckets = new int[numBuckets];
+        for (bucket = 0; bucket < numBuckets; bucket++)
+            buckets[bucket] = -1;
+        numInUse = 0;
+        for (int j = 0; j < tableSize; j++)
+            if (table[j].inUse && j != i)
+                Hash(j);
+    }
+    bucket = HashName(table[i].name) & (numBuckets - 1);
+    table[i].next = buckets[bucket];
+    buckets[bucket] = i;
+    numInUse++;
+}
+
+//----------------------------------------------------------------------
+// Directory::Unhash
+// 	Take entry "i" out of the hash table.
+//----------------------------------------------------------------------
+
+void Directory::Unhash(int i)
+{
+    int *link = &buckets[HashName(table[i].name) & (numBuckets - 1)];
+
+    while (*link != i)
+    {
+        ASSERT(*link != -1);
+        link = &table[*link].next;
+    }
+    *link = table[i].next;
+    numInUse--;
+}
+
+//----------------------------------------------------------------------
+// Directory::AddFree
+// 	Put entry "i", which is not in use, on the free list for its
+//	length.
+//----------------------------------------------------------------------
+
+void Directory::AddFree(int i)
+{
+    int list = FreeList(table[i].length);
+
+    table[i].next = freeLists[list];
+    freeLists[list] = i;
 }
 
 //----------------------------------------------------------------------
@@ -92,8 +310,10 @@ void Directory::WriteBack(OpenFile *file)
 
 int Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
+    int i;
+
+    for (i = buckets[HashName(name) & (numBuckets - 1)]; i != -1; i = table[i].next)
+        if (!strcmp(table[i].name, name))
             return i;
     return -1; // name not in directory
 }
@@ -120,28 +340,46 @@ int Directory::Find(char *name)
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	it is too long.
+//
+//	The entry goes in the shortest free record that is big enough,
+//	if there is one, and otherwise at the end of the directory file.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"isDir" -- is the file a directory?
 //----------------------------------------------------------------------
 
 bool Directory::Add(char *name, int newSector, bool isDir)
 {
-    if (FindIndex(name) != -1)
+    int length = strlen(name);
+    int i = -1;
+
+    if (length > FileNameMaxLen || FindIndex(name) != -1)
         return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse)
+    for (int list = FreeList(RecordLength(length)); i == -1 && list < (int)NumFreeLists; list++)
+        if (freeLists[list] != -1)
         {
-            table[i].inUse = TRUE;
-            table[i].isDir = isDir;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            return TRUE;
+            i = freeLists[list];
+            freeLists[list] = table[i].next;
         }
-    return FALSE; // no space.  Fix when we have extensible files.
+    if (i == -1)
+    { // nothing to re-use; add a record at the end of the file
+        i = NewEntry();
+        table[i].offset = fileLength;
+        table[i].length = RecordLength(length);
+        fileLength += table[i].length;
+    }
+
+    table[i].inUse = TRUE;
+    table[i].isDir = isDir;
+    table[i].name = new char[length + 1];
+    strcpy(table[i].name, name);
+    table[i].sector = newSector;
+    table[i].dirty = TRUE;
+    Hash(i);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -158,11 +396,16 @@ bool Directory::Remove(char *name)
 
     if (i == -1)
         return FALSE; // name not in directory
+    Unhash(i);
     table[i].inUse = FALSE;
+    delete[] table[i].name;
+    table[i].name = NULL;
+    table[i].dirty = TRUE;
+    AddFree(i);
     return TRUE;
 }
 
-bool Directory::recurRemove(PersistentBitmap* freeMap){
+bool Directory::recurRemove(){
     for(int i = 0; i < tableSize; i++){
         if(!table[i].inUse)
             continue;
@@ -170,23 +413,43 @@ bool Directory::recurRemove(PersistentBitmap* freeMap){
             Directory* nextDir = new Directory(NumDirEntries);
             OpenFile* nextDirFile = new OpenFile(table[i].sector);
             nextDir->FetchFrom(nextDirFile);
-            nextDir->recurRemove(freeMap);
-            freeMap->Clear(table[i].sector);
+            nextDir->recurRemove();
             delete nextDir;
             delete nextDirFile;
         }
-        else{
-            FileHeader* nextFile = new FileHeader;
-            nextFile->FetchFrom(table[i].sector);
-            nextFile->Deallocate(freeMap);
-            freeMap->Clear(table[i].sector);
-            delete nextFile;
-        }
-        table[i].inUse = FALSE;
+        kernel->inodeTable->Remove(table[i].sector); // unless it is open
+        Remove(table[i].name);
     }
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Directory::LockSubdirectories
+// 	Lock every directory in this one for writing, then every one in
+//	those, and so on down, and add their files to "locked" for the
+//	caller to close.  Used before this directory is removed, to wait
+//	until nobody is using anything below it.
+//----------------------------------------------------------------------
+
+void Directory::LockSubdirectories(::List<OpenFile *> *locked)
+{
+    Directory *subDir;
+    OpenFile *subFile;
+
+    for (int i = 0; i < tableSize; i++)
+    {
+        if (!table[i].inUse || !table[i].isDir)
+            continue;
+        subFile = new OpenFile(table[i].sector);
+        subFile->Acquire(TRUE);
+        locked->Append(subFile);
+        subDir = new Directory(NumDirEntries);
+        subDir->FetchFrom(subFile);
+        subDir->LockSubdirectories(locked);
+        delete subDir;
+    }
+}
+
 bool Directory::isDir(char* name) {
     int i = FindIndex(name);
     if (i == -1)
@@ -222,6 +485,7 @@ void Directory::RecurList(int depth){
             delete dirFile;
         }
     }
+    delete nextDir;
 }
 
 //----------------------------------------------------------------------
@@ -18,13 +18,39 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "list.h"
 
-#define FileNameMaxLen 9 // for simplicity, we assume \
-                         // file names are <= 9 characters long
+#define FileNameMaxLen 255 // file names are at most 255 characters long
+
+// The following class defines the header of a directory "record", as
+// it is stored on disk.  A directory file is a sequence of records,
+// each a DirectoryRecord followed by the name of the file (without a
+// trailing '\0'), padded to a multiple of 4 bytes.  A record that is no
+// longer in use has a sector of -1; it can be re-used for any name
+// that fits in it.
+
+class DirectoryRecord
+{
+public:
+    int sector;               // Location on disk of the FileHeader,
+                              //   -1 if the record is free
+    short length;             // Bytes taken by the record, name and
+                              //   padding included
+    unsigned char nameLength; // Length of the name
+    char isDir;               // Is the file a directory?
+};
+
+// Free records are kept on lists by their length, in words, so that
+// one big enough for a new name is found without looking at every
+// entry.  Records longer than one for the longest name share the last
+// list.
+
+#define NumFreeLists ((sizeof(DirectoryRecord) + FileNameMaxLen + sizeof(int) - 1) / sizeof(int) + 1)
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  Entries are kept in the
+// same order as their records in the directory file.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
@@ -32,29 +58,42 @@
 class DirectoryEntry
 {
 public:
-    bool inUse;                    // Is this directory entry in use?
-    int sector;                    // Location on disk to find the
-                                   //   FileHeader for this file
-    char name[FileNameMaxLen + 1]; // Text name for file, with +1 for
-                                   // the trailing '\0'
-    bool isDir;                    // Is this directory entry a directory?
+    bool inUse;  // Is this directory entry in use?
+    int sector;  // Location on disk to find the
+                 //   FileHeader for this file
+    char *name;  // Text name for file, with a trailing '\0';
+                 //   NULL if not in use
+    bool isDir;  // Is this directory entry a directory?
+    int offset;  // Where its record is in the directory file
+    int length;  // Size of the record
+    int next;    // Next entry in the same hash chain (or free
+                 //   list), -1 if none
+    bool dirty;  // Has it changed since it was last read or
+                 //   written?
 };
 
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file, which
+// grows as files are added to the directory.
+//
+// In memory, the entries are kept in an array, and indexed by a hash
+// table on the name, so that looking up a name takes constant time
+// however big the directory is.  Free records are kept on lists by
+// length, so that adding a name does too.
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk.
+// from/to disk.  WriteBack only writes the entries that have changed
+// since the last FetchFrom or WriteBack.
 
 class Directory
 {
 public:
     Directory(int size); // Initialize an empty directory
-                         // with space for "size" files
+                         // with room for "size" files to start with
     ~Directory();        // De-allocate the directory
 
     void FetchFrom(OpenFile *file); // Init directory contents from disk
@@ -68,7 +107,11 @@ public:
 
     bool Remove(char *name); // Remove a file from the directory
 
-    bool recurRemove(PersistentBitmap* freeMap); // Remove a directory recursively
+    bool recurRemove(); // Remove a directory recursively
+
+    void LockSubdirectories(::List<OpenFile *> *locked);
+                        // Lock every directory below this one
+                        // for writing, and add it to "locked"
 
     bool isDir(char* name); // Check if a file is a directory
 
@@ -86,16 +129,31 @@ private:
     /*
 		MP4 Hint:
 		Directory is actually a "file", be careful of how it works with OpenFile and FileHdr.
-		Disk part: table
-		In-core part: tableSize
+		Disk part: records
+		In-core part: table, buckets
 	*/
 
-    int tableSize;         // Number of directory entries
+    int tableSize;         // Number of directory entries, in use
+                           //   or not
+    int maxEntries;        // Room in "table"
     DirectoryEntry *table; // Table of pairs:
                            // <file name, file header location>
+    int freeLists[NumFreeLists]; // For each record length, the first
+                           //   free entry of that length, -1 if none
+    int fileLength;        // Bytes of records in the directory file
+
+    int numBuckets;        // Size of the hash table
+    int *buckets;          // For each hash value, the first entry
+                           //   in its chain, -1 if none
+    int numInUse;          // Entries in use, ie, in the hash table
 
     int FindIndex(char *name); // Find the index into the directory
                                //  table corresponding to "name"
+    int NewEntry();            // Make room for another entry
+    void Hash(int i);          // Put entry "i" in the hash table
+    void Unhash(int i);        // Take entry "i" out of it
+    void AddFree(int i);       // Put entry "i" on its free list
+    void Clear();              // Forget all entries
 };
 
 #endif // DIRECTORY_H
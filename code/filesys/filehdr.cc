@@ -26,7 +26,7 @@
 
 #include "filehdr.h"
 #include "debug.h"
-#include "synchdisk.h"
+#include "buffercache.h"
 #include "main.h"
 
 //----------------------------------------------------------------------
@@ -41,18 +41,54 @@ FileHeader::FileHeader()
 	numBytes = -1;
 	numSectors = -1;
 	memset(dataSectors, -1, sizeof(dataSectors));
+	for (int i = 0; i < NumDirect; i++)
+		children[i] = NULL;
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	De-allocate the in-core copies of the indirect blocks' headers.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
-	// nothing to do now
+	FreeChildren();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Child
+// 	Return the file header stored in block "i" of an indirect header,
+//	reading it from disk the first time it is asked for.  After that,
+//	translating an offset in the same part of the file needs no I/O.
+//
+//	"i" is the index of the block in dataSectors
+//----------------------------------------------------------------------
+
+FileHeader *
+FileHeader::Child(int i)
+{
+	ASSERT(numBytes > DirectSize && i >= 0 && i < numSectors);
+	if (children[i] == NULL)
+	{
+		children[i] = new FileHeader;
+		children[i]->FetchFrom(dataSectors[i]);
+	}
+	return children[i];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeChildren
+// 	Throw away the in-core copies of the indirect blocks' headers
+//	(and, recursively, their children).
+//----------------------------------------------------------------------
+
+void FileHeader::FreeChildren()
+{
+	for (int i = 0; i < NumDirect; i++)
+	{
+		delete children[i];
+		children[i] = NULL;
+	}
 }
 
 //----------------------------------------------------------------------
@@ -60,7 +96,7 @@ FileHeader::~FileHeader()
 // 	Initialize a fresh file header for a newly created file.
 //	Allocate data blocks for the file out of the map of free disk blocks.
 //	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	the new file, or it would be bigger than MaxFileSize.
 //
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
@@ -68,11 +104,15 @@ FileHeader::~FileHeader()
 
 bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 {
+	if (fileSize < 0 || fileSize > MaxFileSize)
+		return FALSE; // too big for the indirect blocks
 	numBytes = fileSize;
 	numSectors = divRoundUp(fileSize, SectorSize);
 	if (freeMap->NumClear() < numSectors)
 		return FALSE; // not enough space
 
+	if (AllocateExtents(freeMap))
+		return TRUE;
 	
 	if(fileSize <= DirectSize){
 		for (int i = 0; i < numSectors; i++)
@@ -113,8 +153,8 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 				indFile->Allocate(freeMap, fileSize);
 				fileSize = 0;
 			}
-			indFile->WriteBack(dataSectors[curSector]);
-			delete indFile;
+			indFile->WriteIndex(dataSectors[curSector]);
+			children[curSector] = indFile;
 			curSector = curSector + 1;
 		}
 		numSectors = curSector;
@@ -122,6 +162,326 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 	return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::AllocateExtents
+// 	Try to allocate the numSectors sectors of a new file as a few long
+//	runs of consecutive sectors: a single run if there is one that is
+//	big enough, otherwise the longest runs available.  If that takes
+//	more than MaxExtents runs, give the sectors back and return FALSE.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool FileHeader::AllocateExtents(PersistentBitmap *freeMap)
+{
+	int remaining = numSectors;
+	int count, length;
+
+	memset(dataSectors, 0, sizeof(dataSectors));
+	for (count = 0; remaining > 0 && count < MaxExtents; count++)
+	{
+		dataSectors[2 * count] = freeMap->FindAndSetRun(remaining, &length);
+		ASSERT(dataSectors[2 * count] >= 0); // we checked there was room
+		dataSectors[2 * count + 1] = length;
+		remaining -= length;
+	}
+	if (remaining > 0)
+	{ // too fragmented
+		for (int i = 0; i < count; i++)
+			for (int j = 0; j < dataSectors[2 * i + 1]; j++)
+				freeMap->Clear(dataSectors[2 * i] + j);
+		memset(dataSectors, -1, sizeof(dataSectors));
+		return FALSE;
+	}
+	DEBUG(dbgFile, "Allocated " << numSectors << " sectors in " << count << " extents");
+	numSectors = ExtentFormat;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ChildSize
+// 	Return how many bytes of a file of "length" bytes each block in
+//	its header's table covers, when the table points at indirect
+//	headers; 0 if the file fits in DirectSize, so the blocks are data.
+//----------------------------------------------------------------------
+
+static int
+ChildSize(int length)
+{
+	if (length <= (int)DirectSize)
+		return 0;
+	else if (length <= (int)SingleIndSize)
+		return DirectSize;
+	else if (length <= (int)DoubleIndSize)
+		return SingleIndSize;
+	return DoubleIndSize;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Grow a file to "newLength" bytes, allocating data blocks (and index
+//	blocks) for the new part out of the map of free disk blocks.  The
+//	sectors the file already has stay where they are.  Return FALSE,
+//	leaving the header unchanged, if there is not enough free space,
+//	or the file would be bigger than MaxFileSize.
+//
+//	Only the in-memory header is changed; the caller must write it
+//	back, after the new index blocks (written here) and the free map.
+//	Until then, the header on disk still describes the file as it was.
+//
+//	An extent-based file grows by lengthening its last extent, if the
+//	sectors after it are free, or else by adding extents.  If it would
+//	need too many, it is rebuilt once from the list of its data
+//	sectors, plus the new ones, as a tree of indirect blocks.  A file
+//	that already has a table of pointers grows in place (see Grow), so
+//	no index block is ever given back.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newLength" is the new size of the file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::Extend(PersistentBitmap *freeMap, int newLength)
+{
+	int oldSectors = divRoundUp(numBytes, SectorSize);
+	int newSectors = divRoundUp(newLength, SectorSize);
+	int *sectors;
+	int start, length, i;
+
+	if (newLength <= numBytes)
+		return TRUE;
+	if (newLength > MaxFileSize)
+		return FALSE; // too big for the indirect blocks
+	DEBUG(dbgFile, "Extending file from " << numBytes << " to " << newLength << " bytes");
+	if (newSectors == oldSectors ||
+		(numSectors == ExtentFormat && ExtendExtents(freeMap, newSectors - oldSectors)))
+	{
+		numBytes = newLength;
+		return TRUE;
+	}
+
+	// make sure there is room for the data, and for the worst case of
+	// index blocks, before changing anything
+	if (freeMap->NumClear() < newSectors - oldSectors + divRoundUp(newSectors, NumDirect - 1) + 3)
+		return FALSE;
+
+	if (numSectors != ExtentFormat)
+	{
+		Grow(freeMap, newLength);
+		return TRUE;
+	}
+
+	// extents have no index blocks, so nothing is given back here
+	sectors = new int[newSectors];
+	for (i = 0; i < oldSectors; i++)
+		sectors[i] = ByteToSector(i * SectorSize);
+	while (i < newSectors)
+	{
+		start = freeMap->FindAndSetRun(newSectors - i, &length);
+		ASSERT(start >= 0);
+		while (length-- > 0)
+			sectors[i++] = start++;
+	}
+	Build(freeMap, sectors, newSectors, newLength);
+	delete[] sectors;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Grow
+// 	Grow a file whose header is a table of pointers to "newLength"
+//	bytes, keeping its index blocks.  If the file needs one more level
+//	of indirection, the table so far moves into a new index block,
+//	which becomes the first child.  Then the last child grows (in the
+//	same way), and new children are allocated for the rest, as in
+//	Allocate.
+//
+//	New index blocks are written straight to disk; a child that
+//	already existed is written back as part of the open transaction.
+//	There must be enough free space (Extend checks).
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newLength" is the new size of the file, in bytes
+//----------------------------------------------------------------------
+
+void FileHeader::Grow(PersistentBitmap *freeMap, int newLength)
+{
+	int childSize = ChildSize(newLength);
+	bool newChild = FALSE;
+	FileHeader *child;
+	int last, pos;
+	bool success;
+
+	ASSERT(numSectors != ExtentFormat);
+	if (childSize == 0)
+	{ // still a table of data blocks
+		for (; numSectors < divRoundUp(newLength, SectorSize); numSectors++)
+		{
+			dataSectors[numSectors] = freeMap->FindAndSet();
+			ASSERT(dataSectors[numSectors] >= 0); // we checked there was room
+		}
+		numBytes = newLength;
+		return;
+	}
+
+	if (ChildSize(numBytes) < childSize)
+	{ // push the table down a level
+		child = new FileHeader;
+		child->numBytes = numBytes;
+		child->numSectors = numSectors;
+		memcpy(child->dataSectors, dataSectors, sizeof(dataSectors));
+		memcpy(child->children, children, sizeof(children));
+		for (int i = 0; i < NumDirect; i++)
+			children[i] = NULL;
+		memset(dataSectors, 0, sizeof(dataSectors));
+		dataSectors[0] = freeMap->FindAndSet();
+		ASSERT(dataSectors[0] >= 0);
+		children[0] = child;
+		numSectors = 1;
+		newChild = TRUE;
+	}
+	numBytes = newLength;
+
+	last = numSectors - 1;
+	child = Child(last);
+	success = child->Extend(freeMap, min(newLength - last * childSize, childSize));
+	ASSERT(success);
+	if (newChild)
+		child->WriteIndex(dataSectors[last]);
+	else
+		child->WriteBack(dataSectors[last]);
+
+	for (pos = numSectors * childSize; pos < newLength; pos += childSize)
+	{
+		dataSectors[numSectors] = freeMap->FindAndSet();
+		ASSERT(dataSectors[numSectors] >= 0);
+		child = new FileHeader;
+		child->Allocate(freeMap, min(childSize, newLength - pos));
+		child->WriteIndex(dataSectors[numSectors]);
+		children[numSectors++] = child;
+	}
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendExtents
+// 	Try to add "count" sectors to the end of an extent-based file:
+//	first by lengthening the last extent, then with new extents.
+//	If the file would need more than MaxExtents, undo everything and
+//	return FALSE.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"count" is the number of sectors to add
+//----------------------------------------------------------------------
+
+bool FileHeader::ExtendExtents(PersistentBitmap *freeMap, int count)
+{
+	int saved[NumDirect];
+	int used, grown, length, start;
+
+	memcpy(saved, dataSectors, sizeof(dataSectors));
+	for (used = 0; used < MaxExtents && dataSectors[2 * used + 1] > 0; used++)
+		;
+	grown = 0;
+	if (used > 0)
+	{ // lengthen the last extent, as far as possible
+		grown = freeMap->MarkRun(dataSectors[2 * used - 2] + dataSectors[2 * used - 1], count);
+		dataSectors[2 * used - 1] += grown;
+		count -= grown;
+	}
+	for (; count > 0 && used < MaxExtents; used++)
+	{
+		start = freeMap->FindAndSetRun(count, &length);
+		if (start < 0)
+			break;
+		dataSectors[2 * used] = start;
+		dataSectors[2 * used + 1] = length;
+		count -= length;
+	}
+	if (count == 0)
+		return TRUE;
+
+	// no good; give back whatever we took
+	for (int i = 0; i < MaxExtents; i++)
+	{
+		int first = (dataSectors[2 * i] == saved[2 * i]) ? saved[2 * i + 1] : 0;
+
+		for (int j = first; j < dataSectors[2 * i + 1]; j++)
+			freeMap->Clear(dataSectors[2 * i] + j);
+	}
+	memcpy(dataSectors, saved, sizeof(dataSectors));
+	return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Build
+// 	Make this the header of a file of "length" bytes, whose data is in
+//	the given sectors (which are already allocated): as extents, if
+//	they fall into few enough runs, or else as a table of pointers,
+//	with indirect blocks if need be.  Index blocks are allocated from
+//	"freeMap" and written straight to disk.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"sectors" is the list of data sectors, in file order
+//	"count" is the number of data sectors
+//	"length" is the size of the file, in bytes
+//----------------------------------------------------------------------
+
+void FileHeader::Build(PersistentBitmap *freeMap, int *sectors, int count,
+					   int length)
+{
+	int runs, i;
+
+	ASSERT(length <= MaxFileSize); // checked before allocating
+	FreeChildren();
+	numBytes = length;
+	for (runs = 0, i = 0; i < count; i++)
+		if (i == 0 || sectors[i] != sectors[i - 1] + 1)
+			runs++;
+
+	memset(dataSectors, 0, sizeof(dataSectors));
+	if (runs <= MaxExtents)
+	{
+		for (runs = -1, i = 0; i < count; i++)
+		{
+			if (i == 0 || sectors[i] != sectors[i - 1] + 1)
+				dataSectors[2 * ++runs] = sectors[i];
+			dataSectors[2 * runs + 1]++;
+		}
+		numSectors = ExtentFormat;
+	}
+	else if (length <= DirectSize)
+	{
+		for (i = 0; i < count; i++)
+			dataSectors[i] = sectors[i];
+		numSectors = count;
+	}
+	else
+	{
+		int DivFileSize;
+		if(length <= SingleIndSize){
+			DivFileSize = DirectSize;
+		}else if(length <= DoubleIndSize){
+			DivFileSize = SingleIndSize;
+		}else{
+			DivFileSize = DoubleIndSize;
+		}
+
+		int perChild = DivFileSize / SectorSize;
+		for (numSectors = 0; length > 0; numSectors++)
+		{
+			int childLength = min(length, DivFileSize);
+			int childCount = divRoundUp(childLength, SectorSize);
+
+			dataSectors[numSectors] = freeMap->FindAndSet();
+			ASSERT(dataSectors[numSectors] >= 0);
+			children[numSectors] = new FileHeader;
+			children[numSectors]->Build(freeMap, &sectors[numSectors * perChild],
+										childCount, childLength);
+			children[numSectors]->WriteIndex(dataSectors[numSectors]);
+			length -= childLength;
+		}
+	}
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
@@ -132,7 +492,15 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 void FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
 	int fileSize = numBytes;
-	if(fileSize <= DirectSize){
+	if(numSectors == ExtentFormat){
+		for(int i = 0; i < MaxExtents; i++)
+			for(int j = 0; j < dataSectors[2 * i + 1]; j++)
+			{
+				ASSERT(freeMap->Test(dataSectors[2 * i] + j)); // ought to be marked!
+				freeMap->Clear(dataSectors[2 * i] + j);
+			}
+	}
+	else if(fileSize <= DirectSize){
 		for(int i = 0; i < numSectors; i++)
 		{
 			ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
@@ -141,12 +509,9 @@ void FileHeader::Deallocate(PersistentBitmap *freeMap)
 	}
 	else{
 		for(int i= 0; i < numSectors; i++){
-			FileHeader *indFile = new FileHeader;
-			indFile->FetchFrom(dataSectors[i]);
-			indFile->Deallocate(freeMap);
+			Child(i)->Deallocate(freeMap);
 			ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
 			freeMap->Clear((int)dataSectors[i]);
-			delete indFile;
 		}
 	}
 }
@@ -160,12 +525,14 @@ void FileHeader::Deallocate(PersistentBitmap *freeMap)
 
 void FileHeader::FetchFrom(int sector)
 {
-	kernel->synchDisk->ReadSector(sector, (char *)this);
+	char buf[SectorSize];
+
+	kernel->bufferCache->ReadSector(sector, buf);
+	memcpy(&numBytes, buf, sizeof(numBytes));
+	memcpy(&numSectors, buf + sizeof(numBytes), sizeof(numSectors));
+	memcpy(dataSectors, buf + 2 * sizeof(int), sizeof(dataSectors));
 
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/
+	FreeChildren(); // fetched again when needed
 }
 
 //----------------------------------------------------------------------
@@ -177,16 +544,41 @@ void FileHeader::FetchFrom(int sector)
 
 void FileHeader::WriteBack(int sector)
 {
-	kernel->synchDisk->WriteSector(sector, (char *)this);
-
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
+	char buf[SectorSize];
+
+	Pack(buf);
+	kernel->bufferCache->WriteSector(sector, buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteIndex
+// 	Write a new indirect header straight to disk, rather than leaving
+//	it in the cache as part of the open transaction.  Nothing points
+//	at it until the header above it is committed, which the journal
+//	makes sure happens after this write reaches the disk; so a big
+//	file's index blocks don't count towards what an operation changes.
+//
+//	"sector" is the newly allocated sector to contain the header
+//----------------------------------------------------------------------
+
+void FileHeader::WriteIndex(int sector)
+{
+	char buf[SectorSize];
+
+	Pack(buf);
+	kernel->bufferCache->WriteThrough(sector, buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Pack
+// 	Copy the disk part of the header into a sector-sized buffer.
+//----------------------------------------------------------------------
+
+void FileHeader::Pack(char *buf)
+{
+	memcpy(buf, &numBytes, sizeof(numBytes));
+	memcpy(buf + sizeof(numBytes), &numSectors, sizeof(numSectors));
+	memcpy(buf + 2 * sizeof(int), dataSectors, sizeof(dataSectors));
 }
 
 //----------------------------------------------------------------------
@@ -202,7 +594,17 @@ void FileHeader::WriteBack(int sector)
 int FileHeader::ByteToSector(int offset)
 {
 	int fileSize = numBytes;
-	if(fileSize <= DirectSize){
+	if(numSectors == ExtentFormat){
+		int sector = offset / SectorSize;
+		for(int i = 0; i < MaxExtents; i++){
+			if(sector < dataSectors[2 * i + 1])
+				return dataSectors[2 * i] + sector;
+			sector -= dataSectors[2 * i + 1];
+		}
+		ASSERTNOTREACHED(); // offset is past the end of the file
+		return -1;
+	}
+	else if(fileSize <= DirectSize){
 		return (dataSectors[offset / SectorSize]);
 	}
 	else{
@@ -219,10 +621,7 @@ int FileHeader::ByteToSector(int offset)
 		}
 
 		int blockIdx = offset / DivFileSize;
-		FileHeader *indFile = new FileHeader;
-		indFile->FetchFrom(dataSectors[blockIdx]);
-		retSector = indFile->ByteToSector(offset - blockIdx*DivFileSize);
-		delete indFile;
+		retSector = Child(blockIdx)->ByteToSector(offset - blockIdx*DivFileSize);
 		return retSector;
 	}
 }
@@ -247,17 +646,24 @@ void FileHeader::Print()
 {
 	int fileSize = numBytes;
 	
-	if(fileSize <= DirectSize){
+	if(numSectors == ExtentFormat || fileSize <= DirectSize){
 		int i, j, k;
 		char *data = new char[SectorSize];
 
-		printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-		for (i = 0; i < numSectors; i++)
-			printf("%d ", dataSectors[i]);
+		if(numSectors == ExtentFormat){
+			printf("FileHeader contents.  File size: %d.  File extents:\n", numBytes);
+			for (i = 0; i < MaxExtents && dataSectors[2 * i + 1] > 0; i++)
+				printf("%d-%d ", dataSectors[2 * i], dataSectors[2 * i] + dataSectors[2 * i + 1] - 1);
+		}
+		else{
+			printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
+			for (i = 0; i < numSectors; i++)
+				printf("%d ", dataSectors[i]);
+		}
 		printf("\nFile contents:\n");
-		for (i = k = 0; i < numSectors; i++)
+		for (i = k = 0; k < numBytes; i++)
 		{
-			kernel->synchDisk->ReadSector(dataSectors[i], data);
+			kernel->bufferCache->ReadSector(ByteToSector(i * SectorSize), data);
 			for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++)
 			{
 				if ('\040' <= data[j] && data[j] <= '\176') // isprint(data[j])
@@ -280,10 +686,7 @@ void FileHeader::Print()
 			printf("Current Block - Maximum Indirect Block with %d blocks\n", numSectors);
 		}
 		for(int i=0;i<numSectors;i++){
-			FileHeader *indFile = new FileHeader;
-			indFile->FetchFrom(dataSectors[i]);
-			indFile->Print();
-			delete indFile;
+			Child(i)->Print();
 		}
 	}
 }
\ No newline at end of file
@@ -29,6 +29,20 @@
 #define DoubleIndSize (NumDirect * NumDirect * NumDirect * SectorSize)
 #define TripleIndSize (NumDirect * NumDirect * NumDirect * NumDirect * SectorSize)
 
+// The biggest file the indirect blocks can describe; a file is never
+// allowed to grow past it, whatever format its header is in.
+
+#define MaxFileSize TripleIndSize
+
+// A header can instead describe the file as a list of extents -- runs
+// of consecutive sectors -- stored as (first sector, length) pairs in
+// dataSectors.  Such a header is marked by ExtentFormat in the place of
+// numSectors, which is never negative in an indirect header; that way,
+// disks written before extents existed still read correctly.
+
+#define ExtentFormat (-1)
+#define MaxExtents (NumDirect / 2)
+
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
 // The file header is organized as a simple table of pointers to
@@ -43,6 +57,11 @@
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
 // reading it from disk.
+//
+// A new file is given extents if its sectors fit in MaxExtents runs,
+// so that reading it sequentially doesn't seek, and its header needs
+// no indirect blocks however big the file is.  Otherwise, it falls
+// back to the table of pointers (and indirect blocks).
 
 class FileHeader
 {
@@ -56,6 +75,10 @@ public:
 														   //  on disk for the file data
 	void Deallocate(PersistentBitmap *bitMap);			   // De-allocate this file's
 														   //  data blocks
+	bool Extend(PersistentBitmap *bitMap, int newLength);  // Grow the file to
+														   //  "newLength" bytes,
+														   //  allocating any new
+														   //  blocks it needs
 
 	void FetchFrom(int sectorNumber); // Initialize file header from disk
 	void WriteBack(int sectorNumber); // Write modifications to file header
@@ -71,6 +94,27 @@ public:
 	void Print(); // Print the contents of the file.
 
 private:
+	bool AllocateExtents(PersistentBitmap *freeMap);
+	// Try to allocate the file's sectors
+	// as at most MaxExtents runs
+	bool ExtendExtents(PersistentBitmap *freeMap, int count);
+	// Try to add "count" sectors to the
+	// end of an extent-based file
+	void Build(PersistentBitmap *freeMap, int *sectors, int count,
+			   int length);
+	// Make this the header of a file
+	// made of the given data sectors
+	void Grow(PersistentBitmap *freeMap, int newLength);
+	// Grow a table of pointers in place,
+	// keeping its index blocks
+	void WriteIndex(int sectorNumber); // Write a new indirect header
+									   //  straight to disk
+	void Pack(char *buf);			   // Copy the disk part into "buf"
+	FileHeader *Child(int i); // Return the header in block "i",
+							  // fetching it if need be (only for
+							  // files bigger than DirectSize)
+	void FreeChildren();	  // Forget about the children fetched
+
 	/*
 		MP4 hint:
 		You will need a data structure to store more information in a header.
@@ -82,14 +126,21 @@ private:
 		
 		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
 		written to a sector on disk.
-		In-core part - none
+		In-core part - children, the headers of the indirect blocks, fetched the first
+		time they are needed and then kept as long as this header is.
 		
 	*/
 
 	int numBytes;				// Number of bytes in the file
-	int numSectors;				// Number of data sectors in the file
+	int numSectors;				// Number of data sectors in the file,
+								// or ExtentFormat
 	int dataSectors[NumDirect]; // Disk sector numbers for each data
-								// block in the file
+								// block in the file (or extents)
+
+	FileHeader *children[NumDirect]; // In-core copies of the headers
+									 // in dataSectors, NULL if not
+									 // fetched yet (or if this header's
+									 // blocks are data)
 };
 
 #endif // FILEHDR_H
\ No newline at end of file
@@ -979,4 +979,62 @@ void FileSystem::Print()
 }
 
 #endif // FILESYS_STUB
-*/
\ No newline at end of file
+*/
+#ifndef FILESYS_STUB
+
+#include "copyright.h"
+#include "main.h"
+#include "filesys.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Write back every change to the file system that is still held
+//	in memory -- file headers changed only in the inode table, and
+//	sectors in the buffer cache -- and empty the journal, since there
+//	is then nothing in it to replay.  (Unlike the rest of FileSystem,
+//	which lives in filesys.h, this needs the kernel, so it is defined
+//	here.)
+//----------------------------------------------------------------------
+
+void FileSystem::Sync()
+{
+    kernel->inodeTable->Sync();
+    journal->Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteBackInode
+// 	Write back the header of "inode", if it has been changed only in
+//	memory (see InodeTable).  (Defined here, since it needs the
+//	inode's lock.)
+//----------------------------------------------------------------------
+
+void FileSystem::WriteBackInode(Inode *inode)
+{
+    inode->lock->AcquireWrite();
+    if (inode->dirty)
+    {
+        journal->Begin();
+        inode->hdr->WriteBack(inode->sector);
+        inode->dirty = FALSE;
+        journal->End();
+    }
+    inode->lock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeWhenClosed
+// 	Free the file whose header is at "sector", which has just been
+//	taken out of its directory: right away, or, if it is open, once
+//	it is closed.  (Defined here, since it needs the kernel.)
+//----------------------------------------------------------------------
+
+void FileSystem::FreeWhenClosed(int sector)
+{
+    kernel->inodeTable->Remove(sector);
+}
+
+#endif // FILESYS_STUB
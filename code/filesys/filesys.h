@@ -26,6 +26,22 @@
 //	stored as files in the Nachos file system -- this causes an interesting
 //	bootstrap problem when the simulated disk is initialized.
 //
+//	Threads may use the file system at the same time.  Each file
+//	(directories included) has a reader-writer lock (see inodetable.h):
+//	a name is looked up with its directory locked for reading, and
+//	entered or removed with it locked for writing, so lookups in a
+//	directory, and reads of a file, go on in parallel.  A path is
+//	walked with each directory locked before the one above it is let
+//	go, and locks are always taken in this order:
+//
+//		directories, parent before child
+//		then the file being written, if any
+//		then the journal (see journal.h)
+//
+//	The free map is only changed inside journal operations, so the
+//	journal's lock, which admits one operation at a time, keeps it
+//	consistent too.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -39,12 +55,19 @@
 #define FreeMapSector 0
 #define DirectorySector 1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize (NumSectors / BitsInByte)
-#define NumDirEntries 10
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+// The metadata journal (see journal.h) takes a fixed area of the disk,
+// right after them.
+#define JournalSector 2
+#define JournalSectors 64
+
+// Initial file sizes for the bitmap and directory.  A directory starts
+// out empty, and grows as files are added to it.
+#define FreeMapFileSize (divRoundUp(numSectors, BitsInWord) * sizeof(unsigned))
+					// in terms of "numSectors", the size
+					// of the disk, known only at run time
+#define NumDirEntries 10	// entries a directory has room for in
+					// memory, to start with
+#define DirectoryFileSize 0
 
 #include "copyright.h"
 #include "sysdep.h"
@@ -55,7 +78,10 @@
 #include "pbitmap.h"
 #include "directory.h"
 #include "filehdr.h"
-#include <sstream>
+#include "dentrycache.h"
+#include "journal.h"
+#include "openfiletable.h"
+#include "inodetable.h"
 
 typedef int OpenFileId;
 
@@ -92,6 +118,8 @@ public:
 
 	bool Remove(char *name) { return Unlink(name) == 0; }
 
+	void Sync() {} // UNIX already has everything
+
 	OpenFile *fileDescriptorTable[20];
 };
 
@@ -99,21 +127,26 @@ public:
 class FileSystem
 {
 public:
-	FileSystem(bool format){
+	FileSystem(bool format, int diskSectors){
 		DEBUG(dbgFile, "Initializing the file system.");
+		numSectors = diskSectors;
+		openFileTable = new OpenFileTable(OpenFileTableSize);
 		if (format)
 		{
-			PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
-			Directory *directory = new Directory(NumDirEntries);
 			FileHeader *mapHdr = new FileHeader;
 			FileHeader *dirHdr = new FileHeader;
 
 			DEBUG(dbgFile, "Formatting the file system.");
+			journal = new Journal(JournalSector, JournalSectors, TRUE);
+			freeMap = new PersistentBitmap(numSectors);
+			dentryCache = new DentryCache(DentryCacheSize);
 
 			// First, allocate space for FileHeaders for the directory and bitmap
 			// (make sure no one else grabs these!)
 			freeMap->Mark(FreeMapSector);
 			freeMap->Mark(DirectorySector);
+			for (int i = 0; i < JournalSectors; i++)
+				freeMap->Mark(JournalSector + i);
 
 			// Second, allocate space for the data blocks containing the contents
 			// of the directory and bitmap files.  There better be enough space!
@@ -145,307 +178,508 @@ public:
 
 			DEBUG(dbgFile, "Writing bitmap and directory back to disk.");
 			freeMap->WriteBack(freeMapFile); // flush changes to disk
-			directory->WriteBack(directoryFile);
-
-			curOpenFile = NULL;
+			ReadDirectory(DirectorySector, directoryFile)->WriteBack(directoryFile);
 
 			if (debug->IsEnabled('f'))
 			{
 				freeMap->Print();
-				directory->Print();
+				ReadDirectory(DirectorySector, directoryFile)->Print();
 			}
-			delete freeMap;
-			delete directory;
 			delete mapHdr;
 			delete dirHdr;
 		}
 		else
 		{
+			// finish anything that was committed to the journal before
+			// Nachos last stopped, before looking at the disk
+			journal = new Journal(JournalSector, JournalSectors, FALSE);
+
 			// if we are not formatting the disk, just open the files representing
 			// the bitmap and directory; these are left open while Nachos is running
 			freeMapFile = new OpenFile(FreeMapSector);
 			directoryFile = new OpenFile(DirectorySector);
+
+			// the bitmap stays in memory too, so that each operation
+			// doesn't have to read it in again (as do directories; see
+			// ReadDirectory)
+			freeMap = new PersistentBitmap(freeMapFile, numSectors);
+			dentryCache = new DentryCache(DentryCacheSize);
 		}
 	}
 	// MP4 mod tag
 	~FileSystem(){
+		delete openFileTable;
+		delete freeMap;
+		delete dentryCache;
+		delete journal;
 		delete freeMapFile;
 		delete directoryFile;
 	}
 
 	bool Create(char *name, int initialSize){
-		Directory *directory;
-		PersistentBitmap *freeMap;
-		FileHeader *hdr;
+		DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
+		return CreateEntry(name, initialSize, FALSE);
+	}
+
+	bool CreateDirectory(char *name){
+		DEBUG(dbgFile, "Creating directory " << name);
+		return CreateEntry(name, DirectoryFileSize, TRUE);
+	}
+
+	OpenFile *Open(char *name){
 		int sector;
-		bool success;
+		bool isDir;
 
-		DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
+		DEBUG(dbgFile, "Opening file" << name);
+
+		return OpenPath(name, &sector, &isDir); // NULL if not found
+	}
+
+	// Remove the file or directory "name".  A directory is only removed
+	// if "recurRemove" is set, in which case everything in it goes too.
+	bool Remove(char *name, bool recurRemove){
+		char last[FileNameMaxLen + 1];
+		Directory *directory, *subDirectory;
+		OpenFile *dirFile, *subFile;
+		::List<OpenFile *> *locked;
+		int dir, sector;
+		bool isDir;
+
+		dir = FindParent(name, last, TRUE, &dirFile);
+		if (dir == -1)
+			return FALSE; // no such path
+		sector = (last[0] == '\0') ? -1 : Lookup(dir, dirFile, last, &isDir);
+		if (sector == -1 || (isDir && !recurRemove))
+		{ // not found (or the root), or a directory without "-rr"
+			ReleaseDirectory(dirFile, TRUE);
+			return FALSE;
+		}
 
-		directory = new Directory(NumDirEntries);
-		directory->FetchFrom(directoryFile);
+		if (isDir)
+		{ // wait until nobody is using anything in the directory; with
+		  // its parent locked, nobody else can start to.  This comes
+		  // before the journal, as the users may be waiting for it
+			locked = new ::List<OpenFile *>;
+			subFile = new OpenFile(sector);
+			subFile->Acquire(TRUE);
+			locked->Append(subFile);
+			subDirectory = ReadDirectory(sector, subFile);
+			subDirectory->LockSubdirectories(locked);
+		}
 
-		OpenFile* curr_dir = directoryFile;
-		string name_str(name);
-		stringstream ss(name_str);
-		char* name_c;
-		while(getline(ss, name_str, '/'))
+		journal->Begin();
+		if (isDir)
 		{
-			name_c = (char*)name_str.c_str();
-			sector = directory->Find(name_c);
-			if(sector == -1)
-				break;
-			else
-			{
-				if(!directory->isDir(name_c)){
-					success = FALSE;
-					break;
-				}
-				curr_dir = new OpenFile(sector);
-				directory->FetchFrom(curr_dir);
-			}
+			subDirectory->recurRemove();
 		}
-		
-		freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-		sector = freeMap->FindAndSet(); // find a sector to hold the file header
-		if (sector == -1)
-			success = FALSE; // no free block for file header
-		else if (!directory->Add(name_c, sector, false))
-			success = FALSE; // no space in directory
-		else
+
+		directory = ReadDirectory(dir, dirFile);
+		directory->Remove(last);
+		directory->WriteBack(dirFile);	 // flush to disk
+
+		FreeWhenClosed(sector); // now, unless it is open
+
+		// the names cached for a removed directory would be wrong once
+		// its header sector is re-used, so forget them all
+		if (isDir)
 		{
-			hdr = new FileHeader;
-			if (!hdr->Allocate(freeMap, initialSize))
-				success = FALSE; // no space on disk for data
-			else
-			{
-				success = TRUE;
-				// everthing worked, flush all changes back to disk
-				hdr->WriteBack(sector);
-				directory->WriteBack(curr_dir);
-				freeMap->WriteBack(freeMapFile);
-			}
-			delete hdr;
+			dentryCache->Purge();
+			while (!locked->IsEmpty()) // frees them, unless open
+				ReleaseDirectory(locked->RemoveFront(), TRUE);
+			delete locked;
 		}
-		delete freeMap;
-		
-		delete directory;
-		return success;
+		dentryCache->Enter(dir, last, -1, FALSE);
+		journal->End();
+		ReleaseDirectory(dirFile, TRUE);
+		return TRUE;
 	}
 
-	bool CreateDirectory(char *name){
+	void List(char* name, bool recur_list){
 		Directory *directory;
-		PersistentBitmap *freeMap;
-		FileHeader *hdr;
+		OpenFile *dirFile;
 		int sector;
-		bool success;
+		bool isDir;
 
-		DEBUG(dbgFile, "Creating directory " << name);
+		dirFile = OpenPath(name, &sector, &isDir);
+		if (dirFile == NULL)
+			return;
+		if (isDir)
+		{
+			dirFile->Acquire(FALSE);
+			directory = ReadDirectory(sector, dirFile);
+			recur_list? directory->RecurList(0): directory->List();
+			dirFile->Release(FALSE);
+		}
+		delete dirFile;
+	}
+
+	void Print(){
+		FileHeader *bitHdr = new FileHeader;
+		FileHeader *dirHdr = new FileHeader;
+
+		printf("Bit map file header:\n");
+		bitHdr->FetchFrom(FreeMapSector);
+		bitHdr->Print();
+
+		printf("Directory file header:\n");
+		dirHdr->FetchFrom(DirectorySector);
+		dirHdr->Print();
+
+		freeMap->Print();
+		ReadDirectory(DirectorySector, directoryFile)->Print();
 
-		directory = new Directory(NumDirEntries);
-		directory->FetchFrom(directoryFile);
+		delete bitHdr;
+		delete dirHdr;
+	}
 
-		OpenFile* curr_dir = directoryFile;
-		string name_str(name);
-		stringstream ss(name_str);
-		char* name_c;
-		while(getline(ss, name_str, '/'))
+	// The following operate on files opened by user programs, named by
+	// their "entry" in the system-wide open file table (see
+	// openfiletable.h); each address space maps its programs'
+	// descriptors to entries.  Each returns -1 if "entry" is not in
+	// use, or the file was not opened for the operation.
+
+	// Open "name" for reading and writing; return its entry, or -1 if
+	// it doesn't exist (or is a directory), or the table is full
+	int OpenAFile(char *name){
+		OpenFile *openFile;
+		int sector, entry;
+		bool isDir;
+
+		DEBUG(dbgFile, "Opening file " << name << " for a user program");
+		openFile = OpenPath(name, &sector, &isDir);
+		if (openFile == NULL)
+			return -1;
+		if (isDir)
 		{
-			name_c = (char*)name_str.c_str();
-			sector = directory->Find(name_c);
-			if(sector == -1)
-			{
-				break;
-			}
-			else
-			{
-				if(!directory->isDir(name_c))
-				{
-					success = FALSE;
-					break;
-				}
-				curr_dir = new OpenFile(sector);
-				directory->FetchFrom(curr_dir);
-			}
+			delete openFile;
+			return -1;
 		}
-		
-		freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+		entry = openFileTable->Add(openFile, OpenForReading | OpenForWriting);
+		if (entry == -1)
+			delete openFile;
+		return entry;
+	}
+
+	// Read/write into/out of several buffers at once, from where the
+	// last Read or Write left off (see OpenFile::ReadV) ...
+	int WriteFileV(char **bufs, int *sizes, int count, int entry){
+		OpenFile *openFile = openFileTable->Get(entry, OpenForWriting);
+
+		if (openFile == NULL)
+			return -1;
+		return openFile->WriteV(bufs, sizes, count);
+	}
+
+	int ReadFileV(char **bufs, int *sizes, int count, int entry){
+		OpenFile *openFile = openFileTable->Get(entry, OpenForReading);
+
+		if (openFile == NULL)
+			return -1;
+		return openFile->ReadV(bufs, sizes, count);
+	}
+
+	// ... or at "position", leaving where the next Read starts alone
+	int WriteFileVAt(char **bufs, int *sizes, int count, int position, int entry){
+		OpenFile *openFile = openFileTable->Get(entry, OpenForWriting);
+
+		if (openFile == NULL || position < 0)
+			return -1;
+		return openFile->WriteVAt(bufs, sizes, count, position);
+	}
+
+	int ReadFileVAt(char **bufs, int *sizes, int count, int position, int entry){
+		OpenFile *openFile = openFileTable->Get(entry, OpenForReading);
+
+		if (openFile == NULL || position < 0)
+			return -1;
+		return openFile->ReadVAt(bufs, sizes, count, position);
+	}
+
+	// Set where the next Read or Write of "entry" starts
+	int SeekFile(int position, int entry){
+		OpenFile *openFile = openFileTable->Get(entry, 0);
+
+		if (openFile == NULL || position < 0)
+			return -1;
+		openFile->Seek(position);
+		return 1;
+	}
+
+	// Another descriptor refers to "entry" (eg, a copy of one)
+	void ShareFile(int entry){
+		openFileTable->Ref(entry);
+	}
+
+	// A descriptor no longer refers to "entry"; the file is closed
+	// once none do.  Closing doesn't sync: what was written goes to
+	// disk with the cache's write-behind and the journal's group
+	// commits, like everything else (a program that needs it there
+	// now calls Sync)
+	int CloseFile(int entry){
+		if (!openFileTable->Release(entry))
+			return -1;
+		return 1;
+	}
+
+	// Grow the file whose header is "inode" to "newLength" bytes.  The
+	// free map goes to disk before the header, so the header on disk
+	// never points at a block that is marked free.  If the file still
+	// fits in its last sector, only the length changes; unless that is
+	// part of a metadata operation (eg, a directory growing), the
+	// header is just marked dirty, and written back later.
+	bool ExtendFile(Inode *inode, int newLength){
+		FileHeader *hdr = inode->hdr;
+		bool sameSectors = (divRoundUp(newLength, SectorSize) ==
+							divRoundUp(hdr->FileLength(), SectorSize));
+		bool success = TRUE;
+
+		if (sameSectors && !journal->InOperation())
+		{
+			hdr->Extend(NULL, newLength);
+			inode->dirty = TRUE;
+			return TRUE;
+		}
+
+		journal->Begin();
+		if (sameSectors)
+			hdr->Extend(NULL, newLength);
+		else if ((success = hdr->Extend(freeMap, newLength)))
+			freeMap->WriteBack(freeMapFile);
+		if (success)
+		{ // along with any earlier change made only in memory
+			hdr->WriteBack(inode->sector);
+			inode->dirty = FALSE;
+		}
+		journal->End();
+		return success;
+	}
+
+	void WriteBackInode(Inode *inode); // Write back a header changed
+									   // only in memory (see filesys.cc)
+
+	// Free the header and data of a removed file, now that nothing
+	// has it open (see InodeTable)
+	void FreeInode(Inode *inode){
+		DEBUG(dbgFile, "Freeing file with header " << inode->sector);
+		journal->Begin();
+		inode->hdr->Deallocate(freeMap); // remove data blocks
+		freeMap->Clear(inode->sector);	 // remove header block
+		freeMap->WriteBack(freeMapFile); // flush to disk
+
+		// the sectors freed may be re-used for file data, which isn't
+		// journaled, so nothing logged for them may be replayed
+		journal->Checkpoint();
+		journal->End();
+	}
+
+	void Sync(); // Write back changes held in the
+				 // buffer cache (see filesys.cc)
+
+	int NumFreeSectors() { return freeMap->NumClear(); } // For testing
+
+private:
+	void FreeWhenClosed(int sector); // Free a file taken out of its
+									 // directory (see filesys.cc)
+
+	// Create a file (or, if "isDir", a directory) at "path", with
+	// "initialSize" bytes of data.
+	bool CreateEntry(char *path, int initialSize, bool isDir){
+		char name[FileNameMaxLen + 1];
+		Directory *directory;
+		OpenFile *dirFile;
+		FileHeader *hdr;
+		int dir, sector;
+		bool success;
+
+		dir = FindParent(path, name, TRUE, &dirFile);
+		if (dir == -1)
+			return FALSE; // no such directory
+		if (name[0] == '\0')
+		{ // no name in it
+			ReleaseDirectory(dirFile, TRUE);
+			return FALSE;
+		}
+
+		journal->Begin();
+		directory = ReadDirectory(dir, dirFile);
 		sector = freeMap->FindAndSet(); // find a sector to hold the file header
 		if (sector == -1)
 			success = FALSE; // no free block for file header
-		else if (!directory->Add(name_c, sector, true))
-			success = FALSE; // no space in directory
+		else if (!directory->Add(name, sector, isDir))
+		{
+			freeMap->Clear(sector);
+			success = FALSE; // already there, or no space in directory
+		}
 		else
 		{
 			hdr = new FileHeader;
-			if (!hdr->Allocate(freeMap, DirectoryFileSize))
+			if (!hdr->Allocate(freeMap, initialSize))
+			{
+				directory->Remove(name);
+				freeMap->Clear(sector);
 				success = FALSE; // no space on disk for data
+			}
 			else
 			{
 				success = TRUE;
 				// everthing worked, flush all changes back to disk
 				hdr->WriteBack(sector);
-				directory->WriteBack(directoryFile);
+				directory->WriteBack(dirFile);
 				freeMap->WriteBack(freeMapFile);
+				dentryCache->Enter(dir, name, sector, isDir);
 			}
 			delete hdr;
 		}
-		delete freeMap;
-		
-		delete directory;
+		journal->End();
+		ReleaseDirectory(dirFile, TRUE);
 		return success;
 	}
 
-	OpenFile *Open(char *name){
-		Directory *directory = new Directory(NumDirEntries);
-		OpenFile *openFile = NULL;
-		int sector;
-
-		DEBUG(dbgFile, "Opening file" << name);
-		directory->FetchFrom(directoryFile);
-		
-		OpenFile* curr_dir = directoryFile;
-		string name_str(name);
-		stringstream ss(name_str);
-		char* name_c;
-		while(getline(ss, name_str, '/')){
-			name_c = (char*)name_str.c_str();
-			sector = directory->Find(name_c);
-			if(sector == -1)
-				break;
-			else{
-				if(!directory->isDir(name_c))
-					break;
-				curr_dir = new OpenFile(sector);
-				directory->FetchFrom(curr_dir);
+	// Find the directory that the last component of "path" is in:
+	// copy that component into "name" ("" if "path" is the root), and
+	// return the sector of the directory's header, or -1 if some
+	// component before it is missing or isn't a directory.  The
+	// directory's file is returned in "*dirFile", locked -- for
+	// writing, if "writing" -- to be let go with ReleaseDirectory.
+	//
+	// The directories on the way are only locked for reading, each
+	// before the one above it is let go, so none of them can be
+	// removed from under the walk (see Remove).
+	int FindParent(char *path, char *name, bool writing, OpenFile **dirFile){
+		int dir = DirectorySector, subDir;
+		OpenFile *subFile;
+		bool exclusive, subExclusive, isDir;
+		int length;
+
+		while (*path == '/')
+			path++;
+		exclusive = writing && IsLast(path);
+		*dirFile = directoryFile;
+		(*dirFile)->Acquire(exclusive);
+		name[0] = '\0';
+		for (;;)
+		{
+			while (*path == '/')
+				path++;
+			if (*path == '\0')
+				return dir;
+			if (name[0] != '\0')
+			{ // there is more, so "name" has to be a directory
+				subDir = Lookup(dir, *dirFile, name, &isDir);
+				if (subDir == -1 || !isDir)
+				{
+					ReleaseDirectory(*dirFile, exclusive);
+					return -1;
+				}
+				subFile = new OpenFile(subDir);
+				subExclusive = writing && IsLast(path);
+				subFile->Acquire(subExclusive);
+				ReleaseDirectory(*dirFile, exclusive);
+				dir = subDir;
+				*dirFile = subFile;
+				exclusive = subExclusive;
+			}
+			for (length = 0; path[length] != '\0' && path[length] != '/'; length++)
+				;
+			if (length > FileNameMaxLen)
+			{
+				ReleaseDirectory(*dirFile, exclusive);
+				return -1;
 			}
+			strncpy(name, path, length);
+			name[length] = '\0';
+			path += length;
 		}
-
-		if (sector >= 0)
-			openFile = new OpenFile(sector); // name was found in directory
-		delete directory;
-		
-		curOpenFile = openFile;
-
-		return openFile; // return NULL if not found
 	}
-	bool Remove(char *name, bool recurRemove){
-		Directory *directory;
-		PersistentBitmap *freeMap;
-		FileHeader *fileHdr;
-		int sector;
 
-		directory = new Directory(NumDirEntries);
-		directory->FetchFrom(directoryFile);
-
-		OpenFile *currDir = directoryFile, *prevDir = NULL;
-		char *prevTok, *currTok;
-		currTok = strtok(name, "/");
-		
-		while(currTok){
-			sector = directory->Find(currTok);
-			if(sector == -1 || !directory->isDir(currTok))
-				break;
-			prevDir = currDir;
-			currDir = new OpenFile(sector);
-			directory->FetchFrom(currDir);
-			prevTok = currTok;
-			currTok = strtok(NULL, "/");
-		}
-
-		if (sector == -1){
-			delete directory;
-			return FALSE; // file not found
-		}
-		currTok = (currTok == NULL) ? prevTok : currTok;
-		freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-
-		if(recurRemove && directory->isDir(currTok)){
-			directory->recurRemove(freeMap);
-			directory->FetchFrom(prevDir);
-			currDir = prevDir;
-			currTok = prevTok;
-		}
-		
-		fileHdr = new FileHeader;
-		fileHdr->FetchFrom(sector);
-
-		fileHdr->Deallocate(freeMap); // remove data blocks
-		freeMap->Clear(sector);       // remove header block
-		directory->Remove(currTok);
-
-		freeMap->WriteBack(freeMapFile);     // flush to disk
-		directory->WriteBack(currDir); // flush to disk
-		delete fileHdr;
-		delete directory;
-		delete freeMap;
-		return TRUE;
+	// Is the component "path" starts with the last one in it?
+	static bool IsLast(char *path){
+		while (*path != '\0' && *path != '/')
+			path++;
+		while (*path == '/')
+			path++;
+		return *path == '\0';
 	}
 
-	void List(char* name, bool recur_list){
-		Directory *directory = new Directory(NumDirEntries);
-		OpenFile* curr_dir = directoryFile;
-		string name_str(name);
-		stringstream ss(name_str);
-		char* name_c;
-
-		while(getline(ss, name_str, '/')){
-			name_c = (char*)name_str.c_str();
-			if(directory->Find(name_c) == -1 || !directory->isDir(name_c))
-				break;
-			curr_dir = new OpenFile(directory->Find(name_c));
-			directory->FetchFrom(curr_dir);
+	// Open the file "path" names, and return where its header is in
+	// "*sector"; NULL if there is no such file.  Its directory stays
+	// locked until it is open, so that it can't be freed in between
+	OpenFile *OpenPath(char *path, int *sector, bool *isDir){
+		char name[FileNameMaxLen + 1];
+		OpenFile *dirFile, *openFile = NULL;
+		int dir = FindParent(path, name, FALSE, &dirFile);
+
+		if (dir == -1)
+			return NULL;
+		if (name[0] == '\0')
+		{ // the root itself
+			*isDir = TRUE;
+			*sector = DirectorySector;
 		}
-		
-		recur_list? directory->RecurList(0): directory->List();
-		delete directory;
+		else
+			*sector = Lookup(dir, dirFile, name, isDir);
+		if (*sector != -1)
+			openFile = new OpenFile(*sector);
+		ReleaseDirectory(dirFile, FALSE);
+		return openFile;
 	}
 
-	void Print(){
-		FileHeader *bitHdr = new FileHeader;
-		FileHeader *dirHdr = new FileHeader;
-		PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-		Directory *directory = new Directory(NumDirEntries);
-
-		printf("Bit map file header:\n");
-		bitHdr->FetchFrom(FreeMapSector);
-		bitHdr->Print();
-
-		printf("Directory file header:\n");
-		dirHdr->FetchFrom(DirectorySector);
-		dirHdr->Print();
-
-		freeMap->Print();
-
-		directory->FetchFrom(directoryFile);
-		directory->Print();
+	// Return the header sector for "name" in the directory whose
+	// header is at "dir" (-1 if it isn't there), and whether it is a
+	// directory.  The caller has the directory's file, "dirFile",
+	// locked.  Asks the dentry cache first, and tells it the answer
+	int Lookup(int dir, OpenFile *dirFile, char *name, bool *isDir){
+		Directory *directory;
+		int sector;
 
-		delete bitHdr;
-		delete dirHdr;
-		delete freeMap;
-		delete directory;
+		if (dentryCache->Lookup(dir, name, &sector, isDir))
+			return sector;
+		directory = ReadDirectory(dir, dirFile);
+		sector = directory->Find(name);
+		*isDir = directory->isDir(name);
+		dentryCache->Enter(dir, name, sector, *isDir);
+		return sector;
 	}
 
-	OpenFile* curOpenFile;
-
-	int WriteFile(char* buffer, int size, OpenFileId id){
-		return curOpenFile->Write(buffer, size);
-	}
+	// Return the directory whose header is at "sector", held in "file"
+	// (which the caller has locked).  It is kept with the file's inode,
+	// and only read in the first time; every change to it is written
+	// back right away.  Two readers may both read it in, in which case
+	// the first one's copy is kept
+	Directory *ReadDirectory(int sector, OpenFile *file){
+		Inode *inode = file->GetInode();
+		Directory *directory;
 
-	int ReadFile(char* buffer, int size, OpenFileId id){
-		return curOpenFile->Read(buffer, size);
+		ASSERT(inode->sector == sector);
+		if (inode->directory == NULL)
+		{
+			directory = new Directory(NumDirEntries);
+			directory->FetchFrom(file);
+			if (inode->directory == NULL)
+				inode->directory = directory;
+			else
+				delete directory;
+		}
+		return inode->directory;
 	}
 
-	void CloseFile(OpenFileId id){
-		delete curOpenFile;
-		curOpenFile = NULL;
+	// Unlock a directory's file, and close it, unless it is the root's,
+	// which stays open
+	void ReleaseDirectory(OpenFile *file, bool writing){
+		file->Release(writing);
+		if (file != directoryFile)
+			delete file;
 	}
 
-private:
 	OpenFile *freeMapFile;	 // Bit map of free disk blocks,
 							 // represented as a file
 	OpenFile *directoryFile; // "Root" directory -- list of
 							 // file names, represented as a file
+	PersistentBitmap *freeMap;	// The bit map, kept in memory
+	DentryCache *dentryCache;	// Recent name lookups
+	Journal *journal;			// Log of changes to metadata
+	OpenFileTable *openFileTable;	// Files opened by user programs
+	int numSectors;			 // Size of the disk, in sectors
 };
 
 #endif // FILESYS
@@ -0,0 +1,234 @@
+// inodetable.cc
+//	Routines to share file headers in memory between the OpenFiles
+//	using them.  See inodetable.h for an overview.
+//
+//	The table is an array of pointers to inodes, searched by sector.
+//	An unused inode is never dirty (the last Put writes it back), so
+//	when a slot is needed, the one unused the longest is simply
+//	dropped; if every inode is in use, the table grows.
+//
+//	The table lock is never held while a header is written back or a
+//	file is freed, since both go through the journal, and may have to
+//	wait for it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "inodetable.h"
+#include "directory.h"
+#include "synch.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize a table with no inodes in it.
+//
+//	"numInodes" -- number of slots to start with
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable(int numInodes)
+{
+    ASSERT(numInodes > 0);
+    this->numInodes = numInodes;
+    inodes = new Inode *[numInodes];
+    for (int i = 0; i < numInodes; i++)
+        inodes[i] = NULL;
+    clock = 0;
+    lock = new Lock("inode table");
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table.  Any header changed only in memory is
+//	lost; call Sync first.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    for (int i = 0; i < numInodes; i++)
+        if (inodes[i] != NULL)
+            Delete(inodes[i]);
+    delete[] inodes;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Delete
+// 	De-allocate an inode that is no longer in the table.
+//----------------------------------------------------------------------
+
+void InodeTable::Delete(Inode *inode)
+{
+    delete inode->hdr;
+    delete inode->directory;
+    delete inode->lock;
+    delete inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Find
+// 	Return the index of the inode for the header at "sector", or -1
+//	if it isn't in the table.
+//----------------------------------------------------------------------
+
+int InodeTable::Find(int sector)
+{
+    for (int i = 0; i < numInodes; i++)
+        if (inodes[i] != NULL && inodes[i]->sector == sector)
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::FreeSlot
+// 	Return the index of an empty slot: one never used, or else the
+//	one whose inode has gone unused the longest, which is dropped.  If
+//	every inode is in use, double the size of the table.
+//----------------------------------------------------------------------
+
+int InodeTable::FreeSlot()
+{
+    int victim = -1;
+    Inode **larger;
+    int i;
+
+    for (i = 0; i < numInodes; i++)
+    {
+        if (inodes[i] == NULL)
+            return i;
+        if (inodes[i]->refCount == 0 &&
+            (victim == -1 || inodes[i]->lastUsed < inodes[victim]->lastUsed))
+            victim = i;
+    }
+    if (victim != -1)
+    {
+        ASSERT(!inodes[victim]->dirty);
+        Delete(inodes[victim]);
+        inodes[victim] = NULL;
+        return victim;
+    }
+
+    DEBUG(dbgFile, "Inode table: growing to " << 2 * numInodes);
+    larger = new Inode *[2 * numInodes];
+    for (i = 0; i < 2 * numInodes; i++)
+        larger[i] = (i < numInodes) ? inodes[i] : NULL;
+    delete[] inodes;
+    inodes = larger;
+    numInodes *= 2;
+    return numInodes / 2;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Get
+// 	Return the inode for the file header at "sector", and note one
+//	more user of it.  If the header isn't in memory, read it in; the
+//	table stays locked meanwhile, so that nobody else reads it in too.
+//
+//	"sector" -- where the header is on disk
+//----------------------------------------------------------------------
+
+Inode *InodeTable::Get(int sector)
+{
+    Inode *inode;
+    int i;
+
+    lock->Acquire();
+    i = Find(sector);
+    if (i == -1)
+    {
+        DEBUG(dbgFile, "Inode table: reading header " << sector);
+        i = FreeSlot();
+        inode = new Inode;
+        inode->sector = sector;
+        inode->hdr = new FileHeader;
+        inode->hdr->FetchFrom(sector);
+        inode->directory = NULL;
+        inode->refCount = 0;
+        inode->lock = new RWLock("inode");
+        inode->dirty = FALSE;
+        inode->removed = FALSE;
+        inodes[i] = inode;
+    }
+    inode = inodes[i];
+    inode->refCount++;
+    inode->lastUsed = clock++;
+    lock->Release();
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Put
+// 	Note that an OpenFile is done with "inode".  If it was the last:
+//	write the header back if it is dirty, or if the file has been
+//	removed, free it.
+//
+//	A dirty header is written back while the inode still counts as
+//	used, so that its slot can't be given away meanwhile; if someone
+//	changes it again in the meantime, it is written again.
+//----------------------------------------------------------------------
+
+void InodeTable::Put(Inode *inode)
+{
+    lock->Acquire();
+    ASSERT(inode->refCount > 0);
+    while (inode->refCount == 1 && inode->dirty && !inode->removed)
+    {
+        lock->Release();
+        kernel->fileSystem->WriteBackInode(inode);
+        lock->Acquire();
+    }
+    if (--inode->refCount > 0 || !inode->removed)
+    {
+        lock->Release();
+        return;
+    }
+
+    // its header sector may be re-used as soon as it is freed, so
+    // nobody may find it in the table any more
+    inodes[Find(inode->sector)] = NULL;
+    lock->Release();
+    kernel->fileSystem->FreeInode(inode);
+    Delete(inode);
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Remove
+// 	Note that the file whose header is at "sector" has been taken out
+//	of its directory.  It is freed right away, unless it is open; then
+//	it is freed when it is closed.
+//----------------------------------------------------------------------
+
+void InodeTable::Remove(int sector)
+{
+    Inode *inode = Get(sector);
+
+    DEBUG(dbgFile, "Inode table: removing " << sector << ", used " << inode->refCount - 1 << " times");
+    inode->removed = TRUE;
+    Put(inode);
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Sync
+// 	Write back every header that has been changed only in memory.
+//----------------------------------------------------------------------
+
+void InodeTable::Sync()
+{
+    Inode *inode;
+
+    lock->Acquire();
+    for (int i = 0; i < numInodes; i++)
+    {
+        inode = inodes[i];
+        if (inode == NULL || !inode->dirty)
+            continue;
+        inode->refCount++; // keep it in the table
+        lock->Release();
+        kernel->fileSystem->WriteBackInode(inode);
+        Put(inode);
+        lock->Acquire();
+    }
+    lock->Release();
+}
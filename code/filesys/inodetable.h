@@ -0,0 +1,97 @@
+// inodetable.h
+//	Data structures for keeping the headers of files in use in
+//	memory, one copy per file.
+//
+//	Each OpenFile used to read in a private copy of its file's header
+//	(in UNIX terms, its "i-node").  Two opens of one file then each
+//	cost a disk read, and worse, when one of them made the file
+//	longer, the other never saw it.  Instead, every OpenFile of a file
+//	now shares a single in-core "Inode", found through this table by
+//	the sector the header lives in.
+//
+//	An inode counts the OpenFiles using it.  Once none are, it stays
+//	in the table, so that opening the file again doesn't read the
+//	header again, until its slot is needed for another file.
+//
+//	A header changed only in memory is marked dirty, and written back
+//	when the last OpenFile using it is closed, or when the file system
+//	is synced.  A file removed while it is still open is only taken
+//	out of its directory; its header and data are freed when the last
+//	OpenFile using it is closed.
+//
+//	The inode of a directory also keeps the directory's contents, once
+//	they have been read in, so that looking up a name or adding one
+//	doesn't read the whole directory again.  The directory is written
+//	back as soon as it changes, so it is dropped along with the inode.
+//
+//	Each inode has a reader-writer lock, so that any number of
+//	threads can read a file at once, but one changing it has it to
+//	itself (see openfile.cc).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef INODETABLE_H
+#define INODETABLE_H
+
+#include "copyright.h"
+#include "filehdr.h"
+
+class Lock;
+class RWLock;
+class Directory;
+
+const int InodeTableSize = 64; // inodes kept in memory, to start with;
+                               // the table grows if more are in use
+
+// The following class defines one file header in memory.
+
+class Inode
+{
+public:
+    int sector;       // Where the header lives on disk
+    FileHeader *hdr;  // The header itself
+    Directory *directory; // If the file is a directory, its
+                      // contents, once read in (else NULL)
+    int refCount;     // Number of OpenFiles using it
+    RWLock *lock;     // Held for reading while the file is read,
+                      // and for writing while it (or its header)
+                      // is being changed
+    bool dirty;       // Changed since it was last written back?
+    bool removed;     // Taken out of its directory; free the file
+                      // when the last OpenFile is closed
+    int lastUsed;     // When it was last looked up, to pick an
+                      // unused inode to replace
+};
+
+// The following class defines the table itself.
+
+class InodeTable
+{
+public:
+    InodeTable(int numInodes); // Initialize an empty table
+    ~InodeTable();             // De-allocate the table; any dirty
+                               // headers better have been Sync'ed
+
+    Inode *Get(int sector); // Return the inode for the header at
+                            // "sector", reading it in if need be
+    void Put(Inode *inode); // Done with it
+    void Remove(int sector); // The file has been taken out of its
+                             // directory: free it, now or once it
+                             // is closed
+
+    void Sync(); // Write every dirty header back
+
+private:
+    int Find(int sector); // Index of the inode, or -1
+    int FreeSlot();       // Index of a slot to put another in
+    void Delete(Inode *inode); // De-allocate an inode
+
+    int numInodes;   // Number of slots in the table
+    Inode **inodes;  // The inodes, NULL for an empty slot
+    int clock;       // Counts lookups, for "lastUsed"
+    Lock *lock;      // Protects the table (but not the inodes)
+};
+
+#endif // INODETABLE_H
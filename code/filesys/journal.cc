@@ -0,0 +1,420 @@
+// journal.cc
+//	Routines to log file system metadata, and to replay the log
+//	after a crash.  See journal.h for an overview.
+//
+//	The journal and the buffer cache work together: between Begin
+//	and End, the cache "holds" every sector the operation's thread
+//	changes, so that none of them goes to disk yet.  They stay held
+//	after End, along with the changes of later operations, until the
+//	transaction commits: then the journal copies them out of the
+//	cache, writes them to the log, and lets the cache write them
+//	back as usual.
+//
+//	The log is only ever read by Recover; it is written and read
+//	directly on the disk, never through the cache.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "buffercache.h"
+#include "synchdisk.h"
+#include "bitmap.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Set up the journal, in a reserved area of the disk.
+//
+//	"firstSector" -- the first sector of the area
+//	"numSectors" -- how many sectors it has
+//	"format" -- TRUE if the disk is being formatted, so the area
+//		holds garbage; otherwise, replay whatever the log holds
+//----------------------------------------------------------------------
+
+Journal::Journal(int firstSector, int numSectors, bool format)
+{
+    ASSERT(sizeof(JournalHeader) <= SectorSize);
+    ASSERT(sizeof(JournalDescriptor) <= SectorSize);
+
+    headerSector = firstSector;
+    logStart = firstSector + 1;
+    logSectors = numSectors - 1;
+    head = 0;
+    sequence = 1;
+    checkpointWanted = FALSE;
+    pending = FALSE;
+    started = 0;
+    lock = new Lock("journal");
+    owner = NULL;
+    depth = 0;
+    heldAtBegin = 0;
+
+    for (capacity = logSectors; Needed(capacity) > logSectors; capacity--)
+        ;
+    limit = min(capacity, kernel->bufferCache->NumBuffers() / 2);
+    reserve = MaxOperationSectors +
+              divRoundUp(divRoundUp(kernel->synchDisk->NumSectors(), BitsInWord) *
+                             sizeof(unsigned), SectorSize);
+    if (reserve > limit)
+    {
+        cerr << "The disk's free map is too big for the journal to hold; "
+             << "use a bigger buffer cache (-bc)\n";
+        ASSERT(FALSE);
+    }
+    sectors = new int[capacity];
+    data = new char[capacity * SectorSize];
+
+    if (format)
+        Format();
+    else
+        Recover();
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    delete lock;
+    delete[] sectors;
+    delete[] data;
+}
+
+//----------------------------------------------------------------------
+// Journal::Needed
+// 	Return the number of log sectors it takes to log "count" sectors:
+//	the sectors themselves, and the descriptors that list them.
+//----------------------------------------------------------------------
+
+int Journal::Needed(int count)
+{
+    return count + max(1, divRoundUp(count, SectorsPerDescriptor));
+}
+
+//----------------------------------------------------------------------
+// Journal::Checksum
+// 	Return a checksum of what a descriptor says was logged after it,
+//	so that Recover can tell whether all of it made it to disk.
+//
+//	"descriptor" -- the descriptor
+//	"data" -- the contents of the sectors it lists
+//----------------------------------------------------------------------
+
+unsigned Journal::Checksum(JournalDescriptor *descriptor, char *data)
+{
+    unsigned sum = 2166136261u;
+    char *bytes = (char *)descriptor->sectors;
+    int i;
+
+    for (i = 0; i < descriptor->count * (int)sizeof(int); i++)
+        sum = (sum ^ (unsigned char)bytes[i]) * 16777619u;
+    for (i = 0; i < descriptor->count * SectorSize; i++)
+        sum = (sum ^ (unsigned char)data[i]) * 16777619u;
+    return sum;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Record on disk that the log starts over, with transaction number
+//	"sequence".
+//----------------------------------------------------------------------
+
+void Journal::WriteHeader()
+{
+    char buf[SectorSize];
+    JournalHeader *header = (JournalHeader *)buf;
+
+    bzero(buf, SectorSize);
+    header->magic = JournalMagic;
+    header->sequence = sequence;
+    kernel->synchDisk->WriteSector(headerSector, buf);
+    kernel->synchDisk->Flush();
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Start an empty journal in an area that holds garbage -- perhaps
+//	a log left behind by an earlier file system, whose transaction
+//	numbers might match ours.  Recover stops at the first sector of
+//	the log that isn't a descriptor it expects, so it is enough to
+//	clear that one.
+//----------------------------------------------------------------------
+
+void Journal::Format()
+{
+    char buf[SectorSize];
+
+    bzero(buf, SectorSize);
+    kernel->synchDisk->WriteSector(logStart, buf);
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation: from now on, the sectors this thread changes
+//	are held in the cache, as part of the open transaction.  Only one
+//	thread at a time can be in an operation; others wait here.  A
+//	thread that is already in one just goes deeper.
+//
+//	An operation is never split between transactions, so if the open
+//	transaction might not have room for all of this one's changes, or
+//	it has grown old while nobody was using the journal, commit it
+//	first.
+//----------------------------------------------------------------------
+
+void Journal::Begin()
+{
+    if (owner == kernel->currentThread)
+    {
+        depth++;
+        return;
+    }
+    lock->Acquire();
+    owner = kernel->currentThread;
+    depth = 1;
+    if (Due() || kernel->bufferCache->NumHeld() + reserve > limit)
+        Commit();
+    heldAtBegin = kernel->bufferCache->NumHeld();
+    kernel->bufferCache->HoldChanges(limit);
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish an operation.  Its changes stay held in the cache until
+//	the transaction they are part of commits -- now, if it is due, or
+//	if a checkpoint was asked for.
+//----------------------------------------------------------------------
+
+void Journal::End()
+{
+    ASSERT(owner == kernel->currentThread && depth > 0);
+    if (--depth > 0)
+        return;
+
+    kernel->bufferCache->StopHolding();
+    ASSERT(kernel->bufferCache->NumHeld() - heldAtBegin <= reserve);
+    if (!pending && kernel->bufferCache->NumHeld() > 0)
+    {
+        pending = TRUE;
+        started = kernel->stats->totalTicks;
+    }
+    if (checkpointWanted || Due())
+        Commit();
+    if (checkpointWanted)
+        Empty();
+    owner = NULL;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::InOperation
+// 	Return TRUE if the current thread is in the middle of an
+//	operation, so that whatever it changes becomes part of it.
+//----------------------------------------------------------------------
+
+bool Journal::InOperation()
+{
+    return owner == kernel->currentThread;
+}
+
+//----------------------------------------------------------------------
+// Journal::Due
+// 	Return TRUE if the open transaction should commit: it has changed
+//	enough sectors, or it has been open long enough.
+//----------------------------------------------------------------------
+
+bool Journal::Due()
+{
+    return pending &&
+           (kernel->bufferCache->NumHeld() >= GroupCommitSectors ||
+            kernel->stats->totalTicks - started >= GroupCommitDelay);
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Make sure that everything changed so far is committed and written
+//	back to its home sectors, and that none of it is replayed after a
+//	crash.  If this thread is in an operation, that happens when it
+//	ends.
+//----------------------------------------------------------------------
+
+void Journal::Checkpoint()
+{
+    Begin();
+    checkpointWanted = TRUE;
+    End();
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Write the sectors the cache is holding for the open transaction
+//	to the log, with a single disk request, and then let the cache
+//	write them back to their home sectors.  Afterwards, make sure the
+//	biggest transaction allowed fits in what is left of the log.
+//
+//	Index blocks written straight to disk (see BufferCache::WriteThrough)
+//	must get there before any header logged here that points at them.
+//----------------------------------------------------------------------
+
+void Journal::Commit()
+{
+    int count = kernel->bufferCache->CopyHeld(sectors, data);
+    int length = Needed(count);
+    int numDescriptors = length - count;
+    char *descriptors, **blocks;
+    int done, n, i, b;
+
+    pending = FALSE;
+    if (count == 0)
+        return;
+    ASSERT(count <= limit && head + length <= logSectors);
+    DEBUG(dbgFile, "Journal: committing transaction " << sequence << ", " << count << " sectors");
+    kernel->bufferCache->FlushWrittenThrough();
+
+    descriptors = new char[numDescriptors * SectorSize];
+    bzero(descriptors, numDescriptors * SectorSize);
+    blocks = new char *[length];
+    b = 0;
+    for (done = 0; done < count; done += n)
+    {
+        JournalDescriptor *descriptor = (JournalDescriptor *)
+            &descriptors[(done / SectorsPerDescriptor) * SectorSize];
+
+        n = min(count - done, SectorsPerDescriptor);
+        descriptor->magic = JournalMagic;
+        descriptor->sequence = sequence;
+        descriptor->count = n;
+        descriptor->last = (done + n == count);
+        for (i = 0; i < n; i++)
+            descriptor->sectors[i] = sectors[done + i];
+        descriptor->checksum = Checksum(descriptor, &data[done * SectorSize]);
+
+        blocks[b++] = (char *)descriptor;
+        for (i = 0; i < n; i++)
+            blocks[b++] = &data[(done + i) * SectorSize];
+    }
+
+    DiskRequest request(logStart + head, blocks, length, TRUE);
+    kernel->synchDisk->Submit(&request);
+    request.Wait();
+    kernel->synchDisk->Flush();
+    head += length;
+    sequence++;
+    kernel->stats->numJournalCommits++;
+    kernel->stats->numJournalSectors += length;
+    kernel->bufferCache->ReleaseHeld();
+
+    delete[] descriptors;
+    delete[] blocks;
+
+    if (head + Needed(limit) > logSectors)
+        Empty();
+}
+
+//----------------------------------------------------------------------
+// Journal::Empty
+// 	Checkpoint: write every dirty sector in the cache back home, and
+//	then start the log over.
+//----------------------------------------------------------------------
+
+void Journal::Empty()
+{
+    checkpointWanted = FALSE;
+    kernel->bufferCache->Sync();
+    if (head == 0)
+        return;
+    DEBUG(dbgFile, "Journal: checkpoint, next transaction " << sequence);
+    head = 0;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::ReadTransaction
+// 	Read the transaction at "position" in the log, if it is the one
+//	numbered "sequence" and it was written completely.  Return the
+//	number of log sectors it takes, or 0 if it isn't there.
+//
+//	"position" -- where it should start
+//	"sectors", "data" -- set to the sectors it changed, and their
+//		contents (room for "capacity" of them, since it may have been
+//		written with a bigger cache than this one)
+//	"count" -- set to the number of sectors it changed
+//----------------------------------------------------------------------
+
+int Journal::ReadTransaction(int position, int *sectors, char *data,
+                             int *count)
+{
+    char buf[SectorSize];
+    JournalDescriptor *descriptor = (JournalDescriptor *)buf;
+    int start = position;
+
+    *count = 0;
+    do
+    {
+        if (position >= logSectors)
+            return 0;
+        kernel->synchDisk->ReadSector(logStart + position, buf);
+        if (descriptor->magic != JournalMagic ||
+            descriptor->sequence != sequence ||
+            descriptor->count < 0 ||
+            descriptor->count > SectorsPerDescriptor ||
+            *count + descriptor->count > capacity ||
+            position + 1 + descriptor->count > logSectors)
+            return 0;
+        if (descriptor->count > 0)
+            kernel->synchDisk->ReadSectors(logStart + position + 1,
+                                           &data[*count * SectorSize],
+                                           descriptor->count);
+        if (Checksum(descriptor, &data[*count * SectorSize]) != descriptor->checksum)
+            return 0; // torn write
+        for (int i = 0; i < descriptor->count; i++)
+            sectors[*count + i] = descriptor->sectors[i];
+        *count += descriptor->count;
+        position += 1 + descriptor->count;
+    } while (!descriptor->last);
+    return position - start;
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Replay every committed transaction in the log, in order, and then
+//	checkpoint.  Called when the file system is mounted, before
+//	anything else is read from the disk.
+//
+//	A disk without a journal header was not formatted by this file
+//	system (or not at all); starting a journal on it would overwrite
+//	whatever is there, so give up instead.
+//----------------------------------------------------------------------
+
+void Journal::Recover()
+{
+    char buf[SectorSize];
+    JournalHeader *header = (JournalHeader *)buf;
+    int length, count, replayed = 0;
+
+    kernel->synchDisk->ReadSector(headerSector, buf);
+    if (header->magic != JournalMagic)
+    {
+        cerr << "The disk has no journal; reformat it with -f\n";
+        ASSERT(FALSE);
+    }
+    sequence = header->sequence;
+
+    while ((length = ReadTransaction(head, sectors, data, &count)) > 0)
+    {
+        DEBUG(dbgFile, "Journal: replaying transaction " << sequence << ", " << count << " sectors");
+        for (int i = 0; i < count; i++)
+            kernel->bufferCache->WriteSector(sectors[i], &data[i * SectorSize]);
+        head += length;
+        sequence++;
+        replayed++;
+    }
+    if (replayed > 0)
+        Empty();
+    head = 0;
+}
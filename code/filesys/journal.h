@@ -0,0 +1,167 @@
+// journal.h
+//	Data structures for a write-ahead journal of file system
+//	metadata.
+//
+//	Changing the file system -- creating a file, say -- means
+//	changing several sectors: the file header, the directory, the
+//	free map.  If Nachos dies part way through writing them back,
+//	the disk is left inconsistent (eg, a directory entry pointing at
+//	a header that was never written).  To prevent that, the changes
+//	each operation makes are grouped into a "transaction".  Until it
+//	commits, the buffer cache holds on to the sectors it changed,
+//	rather than writing them back.  To commit, a copy of all of them
+//	is written to the journal, a reserved area of the disk, in one
+//	sequential write; after that, the cache can write them back to
+//	their real ("home") locations whenever it likes.
+//
+//	When the file system is mounted, any transactions still in the
+//	journal are replayed, ie, copied to their home sectors again.  A
+//	transaction that didn't make it to the journal completely is
+//	ignored, along with everything after it.  Either way, every
+//	operation happens entirely, or not at all.
+//
+//	The journal is a log, written from the start of the reserved
+//	area.  When it is nearly full, it is "checkpointed": every dirty
+//	sector in the cache is written home, and the log starts over.
+//
+//	Only metadata is journaled; file data is written to its home
+//	sectors directly.  Since a sector freed by one operation may be
+//	re-used for file data straight away, the log is checkpointed
+//	after any operation that frees sectors, so that nothing stale is
+//	ever replayed on top of that data.
+//
+//	Committing every operation on its own would cost a log write (and
+//	a descriptor sector) each time, even when many operations change
+//	the same few sectors -- as creating a file after another in the
+//	same directory does.  Instead, operations are committed in groups:
+//	each one adds its changes to the open transaction, which commits
+//	once it holds GroupCommitSectors sectors, once it is
+//	GroupCommitDelay ticks old, or when the file system is synced.
+//	Like the cache's write-behind, the age is checked whenever the
+//	journal is used, since Nachos has no timers for threads.  Only one
+//	operation at a time changes metadata; the others wait their turn.
+//
+//	Until its group commits, an operation may be lost in a crash --
+//	but only as a whole, and only along with the operations after it.
+//	To make sure it has stuck, call FileSystem::Sync (the Sync system
+//	call).
+//
+//	An operation is never split between transactions.  A transaction
+//	can only change as many sectors as fit in the log, and as the
+//	cache is willing to hold; so before an operation starts, Begin
+//	makes sure the open transaction has room left for the most any
+//	one operation changes -- MaxOperationSectors, plus the whole free
+//	map -- and if not, commits it first.  New index blocks don't
+//	count: nothing points at them until the header that does commits,
+//	so they are written straight to disk (see FileHeader::WriteIndex).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "copyright.h"
+#include "disk.h"
+
+class Lock;
+class Thread;
+
+const int JournalMagic = 0x4a524e4c;   // marks the journal's own sectors
+const int MaxOperationSectors = 8;     // most sectors one operation may
+                                       // change, besides the free map
+const int GroupCommitSectors = 8;      // commit a group once it has
+                                       // changed this many sectors
+const int GroupCommitDelay = 10000;    // ... or once it is this old (ticks)
+
+// The following class defines the first sector of the reserved area,
+// which says where to start replaying.
+
+class JournalHeader
+{
+public:
+    int magic;    // JournalMagic
+    int sequence; // Number of the transaction at the start of the
+                  // log; any other number found there is left over
+                  // from before the last checkpoint
+};
+
+// A transaction is logged as one or more descriptors, each followed by
+// the contents of the sectors it lists.
+
+const int SectorsPerDescriptor = (SectorSize - 5 * sizeof(int)) / sizeof(int);
+
+class JournalDescriptor
+{
+public:
+    int magic;         // JournalMagic
+    int sequence;      // Transaction this is part of
+    int count;         // Number of sectors logged after it
+    int last;          // Is this the transaction's last descriptor?
+    unsigned checksum; // Of "sectors" and the sectors logged
+    int sectors[SectorsPerDescriptor]; // Home of each sector logged
+};
+
+// The following class defines the journal itself.
+
+class Journal
+{
+public:
+    Journal(int firstSector, int numSectors, bool format);
+    // Use the "numSectors" sectors from
+    // "firstSector" on as the journal;
+    // start it empty if "format",
+    // otherwise replay what is in it
+    ~Journal(); // De-allocate the journal
+
+    void Begin(); // Start changing metadata; nested
+                  // calls are part of the same
+                  // operation
+    void End();   // Done: add it to the open
+                  // transaction, committing that if due
+    bool InOperation(); // Is the current thread between
+                        // Begin and End?
+
+    void Checkpoint(); // Write back everything that has been
+                       // logged, and empty the log (once the
+                       // current transaction commits)
+
+private:
+    void Format();  // Start an empty journal
+    void Recover(); // Replay committed transactions
+    int ReadTransaction(int position, int *sectors, char *data,
+                        int *count);
+    // Read one transaction from the log
+    bool Due();      // Time to commit the open transaction?
+    void Commit();   // Log the changes held in the cache
+    void Empty();    // Checkpoint now
+    void WriteHeader();
+    int Needed(int count); // Log sectors to log "count" sectors
+    unsigned Checksum(JournalDescriptor *descriptor, char *data);
+
+    int headerSector;   // Where the JournalHeader goes
+    int logStart;       // First sector of the log proper
+    int logSectors;     // Its length
+    int head;           // Where the next transaction goes in the log
+    int sequence;       // Number of the next transaction
+    bool checkpointWanted; // Checkpoint when this one commits?
+    bool pending;       // Has an open transaction changed anything?
+    int started;        // If so, when it did first
+
+    Lock *lock;         // Held for the length of a transaction
+    Thread *owner;      // Thread holding it, NULL if none
+    int depth;          // How deeply its Begin calls are nested
+    int heldAtBegin;    // Sectors the transaction had changed
+                        // when the operation began
+
+    int capacity;       // Most sectors one commit can hold (what
+                        // fits in the log)
+    int limit;          // Most sectors a transaction may change
+                        // (what the cache will hold, too)
+    int reserve;        // Most sectors one operation may change
+    int *sectors;       // Home sectors of a commit
+    char *data;         // ... and their contents
+};
+
+#endif // JOURNAL_H
@@ -5,7 +5,8 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  There is only one copy of it,
+//	however many times the file is open (see inodetable.h).
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,21 +17,26 @@
 #include "main.h"
 #include "filehdr.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory (unless it is already there) while the file is open.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    inode = kernel->inodeTable->Get(sector);
+    hdr = inode->hdr;
     seekPosition = 0;
+    lastReadEnd = 0;
+    readAheadWindow = 0;
+    prefetchedTo = 0;
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +46,7 @@ OpenFile::OpenFile(int sector)
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    kernel->inodeTable->Put(inode);
 }
 
 //----------------------------------------------------------------------
@@ -94,26 +100,150 @@ int OpenFile::Write(char *into, int numBytes)
 //	sector at a time.  Thus:
 //
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   The bytes asked for are copied straight out of the buffer cache
+//	   into "into", without staging whole sectors anywhere in between,
+//	   so a big read costs one copy of the data.  If the file is being
+//	   read sequentially, the sectors after the request are read into
+//	   the buffer cache along with it (see ReadAhead).
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   Sectors that are only partially written are changed in place,
+//	   in the buffer cache (see PatchSector), so that we don't overwrite
+//	   the unmodified portion.  The full sectors are simply handed to the
+//	   buffer cache.  Either way, nothing goes to disk until the cache
+//	   writes the sectors back, so a program that writes a file a byte
+//	   at a time costs one sector write, not one per byte.
+//	   A write past the end of the file makes the file longer (see
+//	   Extend); if the disk fills up, as much as fits is written.
 //
 //	"into" -- the buffer to contain the data to be read from disk
 //	"from" -- the buffer containing the data to be written to disk
 //	"numBytes" -- the number of bytes to transfer
 //	"position" -- the offset within the file of the first byte to be
 //			read/written
+//
+//	A read holds the inode's lock for reading, so any number of
+//	threads can read the file at once; a write holds it for writing,
+//	so that nobody sees it half done, or changes the header under it.
 //----------------------------------------------------------------------
 
 int OpenFile::ReadAt(char *into, int numBytes, int position)
+{
+    int result;
+
+    inode->lock->AcquireRead();
+    result = ReadAtLocked(into, numBytes, position);
+    inode->lock->ReleaseRead();
+    return result;
+}
+
+int OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    int result;
+
+    inode->lock->AcquireWrite();
+    result = WriteAtLocked(from, numBytes, position);
+    inode->lock->ReleaseWrite();
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadV/WriteV
+// 	Read/write a portion of a file, starting from seekPosition, into
+//	or out of several buffers, and increment the current position.
+//
+//	Implemented using ReadVAt/WriteVAt.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadV(char **bufs, int *sizes, int count)
+{
+    int result = ReadVAt(bufs, sizes, count, seekPosition);
+    seekPosition += result;
+    return result;
+}
+
+int OpenFile::WriteV(char **bufs, int *sizes, int count)
+{
+    int result = WriteVAt(bufs, sizes, count, seekPosition);
+    seekPosition += result;
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadVAt/WriteVAt
+// 	Read/write the bytes of the file starting at "position" into/out
+//	of "count" buffers, filling each one before going on to the next.
+//	Return the number of bytes transferred in all.
+//
+//	This is one operation on the file, not one per buffer: the lock is
+//	taken once, so nobody sees the transfer half done; a write grows
+//	the file just once; and a read fetches every sector it needs from
+//	disk in one request (along with any read-ahead), however the bytes
+//	are split up among the buffers.
+//
+//	"bufs" -- the buffers
+//	"sizes" -- how many bytes each of them holds
+//	"count" -- the number of buffers
+//	"position" -- the offset within the file of the first byte to be
+//			read/written
+//----------------------------------------------------------------------
+
+int OpenFile::ReadVAt(char **bufs, int *sizes, int count, int position)
+{
+    int fileLength, numBytes = 0, done = 0, n;
+
+    for (int i = 0; i < count; i++)
+        numBytes += sizes[i];
+    inode->lock->AcquireRead();
+    fileLength = hdr->FileLength();
+    if (numBytes > 0 && position < fileLength)
+    {
+        numBytes = min(numBytes, fileLength - position);
+        DEBUG(dbgFile, "Reading " << numBytes << " bytes in " << count << " pieces at " << position);
+        ReadAhead(position, numBytes);
+        for (int i = 0; i < count && done < numBytes; i++)
+        {
+            n = min(sizes[i], numBytes - done);
+            if (n > 0)
+                TransferSectors(bufs[i], position + done, n, FALSE);
+            done += n;
+        }
+    }
+    inode->lock->ReleaseRead();
+    return done;
+}
+
+int OpenFile::WriteVAt(char **bufs, int *sizes, int count, int position)
+{
+    int fileLength, numBytes = 0, done = 0, n;
+
+    for (int i = 0; i < count; i++)
+        numBytes += sizes[i];
+    inode->lock->AcquireWrite();
+    fileLength = hdr->FileLength();
+    if (numBytes > 0 && numBytes > fileLength - position)
+    { // grow the file once, for all of it
+        Extend(position, numBytes);
+        fileLength = hdr->FileLength();
+    }
+    numBytes = min(numBytes, fileLength - position);
+    for (int i = 0; i < count && done < numBytes; i++)
+    {
+        n = min(sizes[i], numBytes - done);
+        done += WriteAtLocked(bufs[i], n, position + done);
+    }
+    inode->lock->ReleaseWrite();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAtLocked/WriteAtLocked
+// 	Do the work of ReadAt/WriteAt, for a caller that holds the inode's
+//	lock.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadAtLocked(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
 
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
@@ -121,62 +251,253 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
         numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
-    firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
-
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                                      &buf[(i - firstSector) * SectorSize]);
-
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete[] buf;
+    ReadAhead(position, numBytes);
+    TransferSectors(into, position, numBytes, FALSE);
     return numBytes;
 }
 
-int OpenFile::WriteAt(char *from, int numBytes, int position)
+int OpenFile::WriteAtLocked(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int firstSector, lastSector, firstFull, lastFull;
+    int end;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if (numBytes <= 0)
         return 0; // check request
-    if ((position + numBytes) > fileLength)
-        numBytes = fileLength - position;
+    if (numBytes > fileLength - position)
+    { // grow the file; if that fails, write what fits
+        Extend(position, numBytes);
+        fileLength = hdr->FileLength();
+        if (position >= fileLength)
+            return 0;
+        if ((position + numBytes) > fileLength)
+            numBytes = fileLength - position;
+    }
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
+    end = position + numBytes;
     firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
+    lastSector = divRoundDown(end - 1, SectorSize);
+    firstFull = divRoundUp(position, SectorSize);
+    lastFull = divRoundDown(end, SectorSize) - 1;
 
-    buf = new char[numSectors * SectorSize];
+    if (firstFull > lastFull)
+    { // the request doesn't cover any sector completely
+        if (firstSector == lastSector)
+        {
+            PatchSector(firstSector, from, position % SectorSize, numBytes);
+            return numBytes;
+        }
+        firstFull = lastFull + 1; // ... but spans two sectors
+    }
 
-    memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
+    // change the partial sectors at either end in place
+    if (firstSector < firstFull)
+        PatchSector(firstSector, from, position % SectorSize,
+                    firstFull * SectorSize - position);
+    if (lastSector > lastFull)
+        PatchSector(lastSector, &from[lastSector * SectorSize - position], 0,
+                    end - lastSector * SectorSize);
 
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+    // and replace the full sectors in between
+    if (firstFull <= lastFull)
+        TransferSectors(&from[firstFull * SectorSize - position],
+                        firstFull * SectorSize,
+                        (lastFull - firstFull + 1) * SectorSize, TRUE);
+    return numBytes;
+}
 
-    // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize],
-               SectorSize, lastSector * SectorSize);
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Grow the file so that it holds a write of "numBytes" bytes at
+//	"position", allocating disk space for it.  The header on disk is
+//	updated as a last step, so until then the file is just as it was.
+//
+//	Any part of the new space that the write does not fill -- the
+//	rest of the old last sector, a gap if "position" is past the end,
+//	and the ends of partially written sectors -- is set to zeros
+//	first.  Sectors the write covers entirely are not touched here,
+//	so they are not written twice.
+//
+//	Return FALSE if there isn't enough room on the disk, or the file
+//	would be bigger than MaxFileSize.  The caller holds the inode's
+//	lock for writing, so that the header changes under one writer at
+//	a time.
+//
+//	"position" -- where the write starts
+//	"numBytes" -- how long it is
+//----------------------------------------------------------------------
 
-    // copy in the bytes we want to change
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+bool OpenFile::Extend(int position, int numBytes)
+{
+    int oldLength = hdr->FileLength();
+    int end, firstFull, lastFull;
+    CacheBuffer *buffer;
 
-    // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                                       &buf[(i - firstSector) * SectorSize]);
-    delete[] buf;
-    return numBytes;
+    if (numBytes > (int)MaxFileSize - position) // (without overflowing "end")
+        return FALSE;
+    end = position + numBytes;
+    firstFull = divRoundUp(position, SectorSize);
+    lastFull = divRoundDown(end, SectorSize) - 1;
+    if (oldLength % SectorSize != 0)
+    { // bytes past the old end may be left over from some other file
+        buffer = kernel->bufferCache->Pin(hdr->ByteToSector(oldLength), FALSE);
+        bzero(&buffer->data[oldLength % SectorSize], SectorSize - oldLength % SectorSize);
+        kernel->bufferCache->Unpin(buffer, TRUE);
+    }
+    if (!kernel->fileSystem->ExtendFile(inode, end))
+        return FALSE;
+
+    for (int i = divRoundUp(oldLength, SectorSize); i < divRoundUp(end, SectorSize); i++)
+    {
+        if (i >= firstFull && i <= lastFull)
+            continue;
+        buffer = kernel->bufferCache->Pin(hdr->ByteToSector(i * SectorSize), TRUE);
+        bzero(buffer->data, SectorSize);
+        kernel->bufferCache->Unpin(buffer, TRUE);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::PatchSector
+// 	Overwrite part of one sector of the file, in the buffer cache.
+//
+//	"sector" -- the sector (within the file) to change
+//	"from" -- the new bytes
+//	"offset" -- where in the sector they go
+//	"numBytes" -- how many there are
+//----------------------------------------------------------------------
+
+void OpenFile::PatchSector(int sector, char *from, int offset, int numBytes)
+{
+    CacheBuffer *buffer;
+
+    buffer = kernel->bufferCache->Pin(hdr->ByteToSector(sector * SectorSize), FALSE);
+    bcopy(from, &buffer->data[offset], numBytes);
+    kernel->bufferCache->Unpin(buffer, TRUE);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::TransferSectors
+// 	Read/write a range of bytes of the file to/from "buf", through the
+//	buffer cache.  Sectors that happen to be consecutive on disk are
+//	handed to it as a single run, so a file laid out contiguously costs
+//	one seek instead of one request per sector when it has to come
+//	from disk.  A read may start and end anywhere; a write covers
+//	whole sectors.
+//
+//	"buf" -- numBytes bytes of file data
+//	"position" -- where in the file they start
+//	"numBytes" -- the number of bytes to transfer
+//	"writing" -- TRUE to write "buf" to disk, FALSE to read it in
+//----------------------------------------------------------------------
+
+void OpenFile::TransferSectors(char *buf, int position, int numBytes,
+                               bool writing)
+{
+    int firstSector = divRoundDown(position, SectorSize);
+    int numSectors = divRoundUp(position + numBytes, SectorSize) - firstSector;
+    int *sectors = new int[numSectors];
+    int i, j, start, end;
+
+    ASSERT(!writing || (position % SectorSize == 0 && numBytes % SectorSize == 0));
+    for (i = 0; i < numSectors; i++)
+        sectors[i] = hdr->ByteToSector((firstSector + i) * SectorSize);
+
+    for (i = 0; i < numSectors; i = j)
+    {
+        for (j = i + 1; j < numSectors && sectors[j] == sectors[i] + (j - i); j++)
+            ;
+        start = max(position, (firstSector + i) * SectorSize);
+        end = min(position + numBytes, (firstSector + j) * SectorSize);
+        if (writing)
+            kernel->bufferCache->WriteSectors(sectors[i], &buf[start - position], j - i);
+        else
+            kernel->bufferCache->ReadBytes(sectors[i], start % SectorSize,
+                                           &buf[start - position], end - start);
+    }
+    delete[] sectors;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called at the start of every read, to detect sequential access.
+//	A read that starts where the last one ended is sequential; while
+//	reads stay sequential, keep the next readAheadWindow sectors of
+//	the file on their way into the buffer cache, so that the reader
+//	finds them there instead of waiting for the disk.
+//
+//	If the sectors being read are not cached yet, they are fetched
+//	as part of the same request as the read-ahead, so that the two
+//	don't cost a seek (or a rotation) each.  Otherwise, new read-ahead
+//	is only started once the reader has used up half of what was read
+//	ahead last time.  Each time, the window doubles, so a long
+//	sequential read settles into a few large disk requests.  Any
+//	other kind of read shuts read-ahead off again.
+//
+//	"position" -- the offset within the file of the read
+//	"numBytes" -- the number of bytes read
+//----------------------------------------------------------------------
+
+void OpenFile::ReadAhead(int position, int numBytes)
+{
+    int firstSector = divRoundDown(position, SectorSize);
+    int nextSector = divRoundUp(position + numBytes, SectorSize);
+    int fileSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int end, i, j;
+
+    if (position != lastReadEnd)
+    { // not sequential; stop reading ahead
+        lastReadEnd = position + numBytes;
+        readAheadWindow = 0;
+        prefetchedTo = 0;
+        return;
+    }
+    lastReadEnd = position + numBytes;
+    if (readAheadWindow > 0 && prefetchedTo - nextSector > readAheadWindow / 2)
+        return; // still well ahead of the reader
+    prefetchedTo = max(prefetchedTo, firstSector);
+
+    if (readAheadWindow == 0)
+        readAheadWindow = MinReadAhead;
+    else
+        readAheadWindow = min(2 * readAheadWindow, MaxReadAhead);
+    end = min(nextSector + readAheadWindow, fileSectors);
+
+    for (i = prefetchedTo; i < end; i = j)
+    {
+        int first = hdr->ByteToSector(i * SectorSize);
+
+        for (j = i + 1; j < end && hdr->ByteToSector(j * SectorSize) == first + (j - i); j++)
+            ;
+        kernel->bufferCache->Prefetch(first, j - i);
+    }
+    prefetchedTo = max(prefetchedTo, end);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Acquire/Release
+// 	Lock the file against writers (and if "writing", against readers
+//	too) across several operations, eg, while a directory is looked
+//	through or changed.  The thread holding the lock may still use
+//	ReadAt and WriteAt (the latter only if "writing").
+//----------------------------------------------------------------------
+
+void OpenFile::Acquire(bool writing)
+{
+    if (writing)
+        inode->lock->AcquireWrite();
+    else
+        inode->lock->AcquireRead();
+}
+
+void OpenFile::Release(bool writing)
+{
+    if (writing)
+        inode->lock->ReleaseWrite();
+    else
+        inode->lock->ReleaseRead();
 }
 
 //----------------------------------------------------------------------
@@ -9,9 +9,8 @@
 //
 //	The other is the "real" implementation, that turns these
 //	operations into read and write disk sector requests.
-//	In this baseline implementation of the file system, we don't
-//	worry about concurrent accesses to the file system
-//	by different threads.
+//	Threads may use a file at the same time: reads of it share the
+//	file's lock, and a write has it to itself.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -74,6 +73,12 @@ private:
 
 #else // FILESYS
 class FileHeader;
+class Inode;
+
+const int MinReadAhead = 4;	 // Sectors read ahead once a file is
+							 // seen to be read sequentially ...
+const int MaxReadAhead = 16; // ... doubling up to this many, as
+							 // long as it still is
 
 class OpenFile
 {
@@ -96,14 +101,53 @@ public:
 	// bypassing the implicit position.
 	int WriteAt(char *from, int numBytes, int position);
 
+	int ReadV(char **bufs, int *sizes, int count);
+	// Read/write "count" buffers' worth
+	// of bytes, one after another, as a
+	// single operation: "scatter/gather"
+	int WriteV(char **bufs, int *sizes, int count);
+	int ReadVAt(char **bufs, int *sizes, int count, int position);
+	int WriteVAt(char **bufs, int *sizes, int count, int position);
+
 	int Length(); // Return the number of bytes in the
 				  // file (this interface is simpler
 				  // than the UNIX idiom -- lseek to
 				  // end of file, tell, lseek back
 
+	void Acquire(bool writing); // Lock the file for reading (or
+								// writing) across several operations
+	void Release(bool writing); // Undo Acquire
+
+	Inode *GetInode() { return inode; } // The in-core header, shared
+										// with other opens of the file
+
 private:
-	FileHeader *hdr;  // Header for this file
+	int ReadAtLocked(char *into, int numBytes, int position);
+	int WriteAtLocked(char *from, int numBytes, int position);
+	// ReadAt/WriteAt, with the lock held
+	void TransferSectors(char *buf, int position, int numBytes,
+						 bool writing);
+	// Read/write file data through the
+	// cache, merging sectors that are
+	// consecutive on disk into runs
+	void PatchSector(int sector, char *from, int offset, int numBytes);
+	// Overwrite part of a file sector
+	void ReadAhead(int position, int numBytes);
+	// Note a read, and prefetch the
+	// sectors after it if the file is
+	// being read sequentially
+	bool Extend(int position, int numBytes);
+	// Grow the file to hold a write
+
+	Inode *inode;	  // The file's header, shared with every
+					  // other OpenFile of the same file
+	FileHeader *hdr;  // inode->hdr, for short
 	int seekPosition; // Current position within the file
+	int lastReadEnd;  // Position just after the last byte read
+	int readAheadWindow; // Sectors to keep read ahead of the
+						 // reader; 0 if not reading sequentially
+	int prefetchedTo; // First sector (within the file) not yet
+					  // read ahead
 };
 
 #endif // FILESYS
@@ -0,0 +1,128 @@
+// openfiletable.cc
+//	Routines to manage the system-wide table of files opened by user
+//	programs.  See openfiletable.h for an overview.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "openfiletable.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// OpenFileTable::OpenFileTable
+// 	Initialize a table with no files in it.
+//
+//	"numEntries" -- number of files that can be open at once
+//----------------------------------------------------------------------
+
+OpenFileTable::OpenFileTable(int numEntries)
+{
+    ASSERT(numEntries > 0);
+    this->numEntries = numEntries;
+    entries = new SystemOpenFile[numEntries];
+    for (int i = 0; i < numEntries; i++)
+    {
+        entries[i].file = NULL;
+        entries[i].mode = 0;
+        entries[i].refCount = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::~OpenFileTable
+// 	Close any files still open, and de-allocate the table.
+//----------------------------------------------------------------------
+
+OpenFileTable::~OpenFileTable()
+{
+    for (int i = 0; i < numEntries; i++)
+        delete entries[i].file;
+    delete[] entries;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::InUse
+// 	Return TRUE if "entry" is a valid index, for an entry that holds
+//	an open file.  User programs can pass any value at all.
+//----------------------------------------------------------------------
+
+bool OpenFileTable::InUse(int entry)
+{
+    return entry >= 0 && entry < numEntries && entries[entry].file != NULL;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Add
+// 	Enter a file that has just been opened, with one descriptor
+//	referring to it.  Return the entry it was put in, or -1 if the
+//	table is full (in which case the caller still owns "file").
+//
+//	"file" -- the file
+//	"mode" -- what it may be used for
+//----------------------------------------------------------------------
+
+int OpenFileTable::Add(OpenFile *file, int mode)
+{
+    ASSERT(file != NULL);
+    for (int i = 0; i < numEntries; i++)
+        if (entries[i].file == NULL)
+        {
+            entries[i].file = file;
+            entries[i].mode = mode;
+            entries[i].refCount = 1;
+            DEBUG(dbgFile, "Open file table: entry " << i << " in use");
+            return i;
+        }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Get
+// 	Return the file in "entry", or NULL if there is none, or it was
+//	not opened for "mode".
+//----------------------------------------------------------------------
+
+OpenFile *OpenFileTable::Get(int entry, int mode)
+{
+    if (!InUse(entry) || (entries[entry].mode & mode) != mode)
+        return NULL;
+    return entries[entry].file;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Ref
+// 	Note that another descriptor refers to "entry".
+//----------------------------------------------------------------------
+
+void OpenFileTable::Ref(int entry)
+{
+    ASSERT(InUse(entry));
+    entries[entry].refCount++;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Release
+// 	Note that a descriptor no longer refers to "entry"; if it was the
+//	last, close the file.  Return FALSE if "entry" was not in use.
+//----------------------------------------------------------------------
+
+bool OpenFileTable::Release(int entry)
+{
+    OpenFile *file;
+
+    if (!InUse(entry))
+        return FALSE;
+    ASSERT(entries[entry].refCount > 0);
+    if (--entries[entry].refCount > 0)
+        return TRUE;
+
+    // free the entry before closing the file, in case that blocks
+    DEBUG(dbgFile, "Open file table: entry " << entry << " closed");
+    file = entries[entry].file;
+    entries[entry].file = NULL;
+    entries[entry].mode = 0;
+    delete file;
+    return TRUE;
+}
@@ -0,0 +1,69 @@
+// openfiletable.h
+//	Data structures for the system-wide table of files opened by user
+//	programs.
+//
+//	A user program names an open file by a small integer, its "file
+//	descriptor" (OpenFileId).  Each address space has its own table
+//	of descriptors (see addrspace.h); each descriptor in use refers
+//	to an entry in this table, which holds the file itself, the mode
+//	it was opened with, and -- inside the OpenFile -- the position the
+//	next Read or Write starts from.  Descriptors that refer to the
+//	same entry share that position.
+//
+//	An entry counts the descriptors that refer to it, and the file is
+//	closed once the last of them is.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef OPENFILETABLE_H
+#define OPENFILETABLE_H
+
+#include "copyright.h"
+#include "openfile.h"
+
+const int OpenFileTableSize = 64; // files open at once, system-wide
+
+// What an open file may be used for
+const int OpenForReading = 1;
+const int OpenForWriting = 2;
+
+// The following class defines one entry of the table.
+
+class SystemOpenFile
+{
+public:
+    OpenFile *file; // The file, NULL if the entry is unused
+    int mode;       // OpenForReading and/or OpenForWriting
+    int refCount;   // Number of descriptors referring to it
+};
+
+// The following class defines the table itself.
+
+class OpenFileTable
+{
+public:
+    OpenFileTable(int numEntries); // Initialize an empty table
+    ~OpenFileTable();              // Close everything, and
+                                   // de-allocate the table
+
+    int Add(OpenFile *file, int mode); // Enter a newly opened file,
+                                       // referred to once; return its
+                                       // entry, or -1 if the table is
+                                       // full
+    OpenFile *Get(int entry, int mode); // Return the file, if "entry"
+                                        // is in use and was opened for
+                                        // "mode"; otherwise NULL
+    void Ref(int entry);     // Another descriptor refers to it
+    bool Release(int entry); // One fewer does; close the file
+                             // when none are left
+
+private:
+    bool InUse(int entry); // Is "entry" a valid entry in use?
+
+    int numEntries;          // Number of entries in the table
+    SystemOpenFile *entries; // The entries themselves
+};
+
+#endif // OPENFILETABLE_H
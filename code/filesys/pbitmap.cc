@@ -8,6 +8,7 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -21,6 +22,10 @@
 
 PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 {
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numMapSectors];
+    for (int i = 0; i < numMapSectors; i++)
+        dirty[i] = TRUE; // nothing is on disk yet
 }
 
 //----------------------------------------------------------------------
@@ -37,10 +42,13 @@ PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 
 PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numItems)
 {
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numMapSectors];
+
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +58,29 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numIte
 
 PersistentBitmap::~PersistentBitmap()
 {
+    delete[] dirty;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark, PersistentBitmap::Clear
+// 	Set or clear the "nth" bit, as for any bitmap, and if that changes
+//	it, remember that the sector holding it must be written back.
+//
+//	"which" is the number of the bit to be set or cleared.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Mark(int which)
+{
+    if (!Test(which))
+        dirty[(which / BitsInByte) / SectorSize] = TRUE;
+    Bitmap::Mark(which);
+}
+
+void PersistentBitmap::Clear(int which)
+{
+    if (Test(which))
+        dirty[(which / BitsInByte) / SectorSize] = TRUE;
+    Bitmap::Clear(which);
 }
 
 //----------------------------------------------------------------------
@@ -62,16 +93,31 @@ PersistentBitmap::~PersistentBitmap()
 void PersistentBitmap::FetchFrom(OpenFile *file)
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Recount();
+    for (int i = 0; i < numMapSectors; i++)
+        dirty[i] = FALSE;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
-// 	Store the contents of a persistent bitmap to a Nachos file.
+// 	Store the contents of a persistent bitmap to a Nachos file.  Only
+//	the sectors that have changed since the bitmap was last fetched or
+//	written back are written; allocating a few sectors usually changes
+//	just one of them.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
 
 void PersistentBitmap::WriteBack(OpenFile *file)
 {
-    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int size = numWords * sizeof(unsigned);
+
+    for (int i = 0; i < numMapSectors; i++)
+    {
+        if (!dirty[i])
+            continue;
+        file->WriteAt((char *)map + i * SectorSize,
+                      min(SectorSize, size - i * SectorSize), i * SectorSize);
+        dirty[i] = FALSE;
+    }
 }
@@ -6,6 +6,9 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bitmap remembers which of its sectors have changed since it
+//    was last fetched or written back, and WriteBack writes only those.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -29,8 +32,17 @@ public:
 
     ~PersistentBitmap(); // deallocate bitmap
 
+    void Mark(int which);  // Set/clear the "nth" bit, noting that
+    void Clear(int which); // its sector must be written back
+
     void FetchFrom(OpenFile *file); // read bitmap from the disk
-    void WriteBack(OpenFile *file); // write bitmap contents to disk
+    void WriteBack(OpenFile *file); // write changed parts of the bitmap
+                                    // to disk
+
+private:
+    int numMapSectors; // Number of sectors the bitmap takes on disk
+    bool *dirty;       // For each of them, has it changed since it
+                       // was last read or written?
 };
 
 #endif // PBITMAP_H
@@ -5,10 +5,11 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Because the physical disk can only handle one operation at a
+//	time, requests are kept on a queue; the disk interrupt handler
+//	marks the current request as done and starts the next one.
+//	Each request has its own semaphore, so that a thread can wait
+//	for its own request to finish without caring about the others.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -17,18 +18,104 @@
 #include "copyright.h"
 #include "synchdisk.h"
 
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to read or write disk sectors.  The request
+//	does nothing until it is handed to SynchDisk::Submit.
+//
+//	"sectorNumber" -- the (first) disk sector to read/write
+//	"data" -- the bytes to be written, or the buffer for the bytes read
+//	"buffers" -- same, as a vector of one buffer per sector
+//	"numSectors" -- the number of consecutive sectors to transfer
+//	"writing" -- TRUE for a write, FALSE for a read
+//	"toCall" -- if non-NULL, object to call back when the request is done
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sectorNumber, char *data, bool writing,
+                         CallBackObj *toCall)
+{
+    Init(sectorNumber, 1, writing, toCall);
+    buffers = new char *[1];
+    buffers[0] = data;
+    ownBuffers = TRUE;
+}
+
+DiskRequest::DiskRequest(int sectorNumber, char *data, int numSectors,
+                         bool writing, CallBackObj *toCall)
+{
+    Init(sectorNumber, numSectors, writing, toCall);
+    buffers = new char *[numSectors];
+    for (int i = 0; i < numSectors; i++)
+        buffers[i] = data + i * SectorSize;
+    ownBuffers = TRUE;
+}
+
+DiskRequest::DiskRequest(int sectorNumber, char **buffers, int numSectors,
+                         bool writing, CallBackObj *toCall)
+{
+    Init(sectorNumber, numSectors, writing, toCall);
+    this->buffers = buffers;
+    ownBuffers = FALSE;
+}
+
+DiskRequest::DiskRequest(CallBackObj *toCall)
+{
+    Init(0, 0, TRUE, toCall);
+    buffers = NULL;
+    ownBuffers = FALSE;
+}
+
+void DiskRequest::Init(int sectorNumber, int count, bool isWrite,
+                       CallBackObj *toCall)
+{
+    ASSERT(count >= 0);
+    sector = sectorNumber;
+    numSectors = count;
+    writing = isWrite;
+    callWhenDone = toCall;
+    done = FALSE;
+    finished = new Semaphore("disk request", 0);
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::~DiskRequest
+// 	De-allocate a request.  The disk must be finished with it.
+//----------------------------------------------------------------------
+
+DiskRequest::~DiskRequest()
+{
+    if (ownBuffers)
+        delete[] buffers;
+    delete finished;
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::Wait
+// 	Block until the disk has finished with this request.  Returns
+//	immediately if it already has.  The semaphore is signalled again
+//	on the way out, so that any number of threads can wait.
+//----------------------------------------------------------------------
+
+void DiskRequest::Wait()
+{
+    finished->P();
+    finished->V();
+}
+
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
 //	initializing the physical disk.
 //
+//	"format" -- if TRUE, give the disk a new geometry
+//	"tracks", "perTrack" -- the new geometry
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(bool format, int tracks, int perTrack)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    queue = new List<DiskRequest *>;
+    current = NULL;
+    disk = new Disk(this, format, tracks, perTrack);
 }
 
 //----------------------------------------------------------------------
@@ -40,8 +127,7 @@ SynchDisk::SynchDisk()
 SynchDisk::~SynchDisk()
 {
     delete disk;
-    delete lock;
-    delete semaphore;
+    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -55,10 +141,10 @@ SynchDisk::~SynchDisk()
 
 void SynchDisk::ReadSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    DiskRequest request(sectorNumber, data, FALSE);
+
+    Submit(&request);
+    request.Wait(); // wait for interrupt
 }
 
 //----------------------------------------------------------------------
@@ -72,19 +158,137 @@ void SynchDisk::ReadSector(int sectorNumber, char *data)
 
 void SynchDisk::WriteSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    DiskRequest request(sectorNumber, data, TRUE);
+
+    Submit(&request);
+    request.Wait(); // wait for interrupt
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read/write a run of consecutive disk sectors from/to a contiguous
+//	buffer, as a single disk request.  Return only after the data has
+//	been transferred.
+//
+//	"sectorNumber" -- the first disk sector to transfer
+//	"data" -- buffer of numSectors * SectorSize bytes
+//	"numSectors" -- the number of sectors to transfer
+//----------------------------------------------------------------------
+
+void SynchDisk::ReadSectors(int sectorNumber, char *data, int numSectors)
+{
+    DiskRequest request(sectorNumber, data, numSectors, FALSE);
+
+    Submit(&request);
+    request.Wait();
+}
+
+void SynchDisk::WriteSectors(int sectorNumber, char *data, int numSectors)
+{
+    DiskRequest request(sectorNumber, data, numSectors, TRUE);
+
+    Submit(&request);
+    request.Wait();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Push every request that has completed so far through the disk's
+//	cache to the platter, and through to the UNIX file behind the
+//	disk.  Requests still on the queue are not covered; callers wait
+//	for their own requests first.
+//----------------------------------------------------------------------
+
+void SynchDisk::Flush()
+{
+    DiskRequest request;
+
+    Submit(&request);
+    request.Wait();
+    disk->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SetCache
+// 	Configure the cache on the disk controller.  Only safe while no
+//	request is in progress.
+//----------------------------------------------------------------------
+
+void SynchDisk::SetCache(int segments, bool writeBack)
+{
+    ASSERT(current == NULL);
+    disk->SetCache(segments, writeBack);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SetCrash
+// 	Make the disk crash part way through the "writes"th write request
+//	from now on, to test recovery.
+//----------------------------------------------------------------------
+
+void SynchDisk::SetCrash(int writes)
+{
+    disk->SetCrash(writes);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Queue a request for the disk, and return without waiting for it.
+//	If the disk is idle, the request is started right away.
+//
+//	"request" -- the request to be queued
+//----------------------------------------------------------------------
+
+void SynchDisk::Submit(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    ASSERT(!request->done);
+    queue->Append(request);
+    if (current == NULL)
+        StartNext();
+    (void)kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	If there is a queued request, send it to the disk.
+//	Assumes interrupts are disabled, and the disk is idle.
+//----------------------------------------------------------------------
+
+void SynchDisk::StartNext()
+{
+    ASSERT(current == NULL);
+    if (queue->IsEmpty())
+        return;
+
+    current = queue->RemoveFront();
+    if (current->numSectors == 0)
+        disk->FlushRequest();
+    else if (current->writing)
+        disk->WriteRequest(current->sector, current->buffers,
+                           current->numSectors);
+    else
+        disk->ReadRequest(current->sector, current->buffers,
+                          current->numSectors);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Mark the current request as done, wake
+//	up any thread waiting for it, and start on the next request.
 //----------------------------------------------------------------------
 
 void SynchDisk::CallBack()
 {
-    semaphore->V();
+    DiskRequest *request = current;
+
+    ASSERT(request != NULL);
+    current = NULL;
+    StartNext();
+
+    request->done = TRUE;
+    request->finished->V();
+    if (request->callWhenDone != NULL)
+        request->callWhenDone->CallBack();
 }
@@ -14,6 +14,65 @@
 #include "disk.h"
 #include "synch.h"
 #include "callback.h"
+#include "list.h"
+
+// The following class describes a single request to the disk.
+// A request covers one sector, or a run of consecutive sectors which
+// are transferred to/from either one contiguous buffer or a vector of
+// sector-sized buffers (scatter/gather).  A request with no sectors
+// flushes the disk's write-back cache.
+//
+// A request is handed to SynchDisk::Submit, which returns immediately;
+// the caller can then poll the request with IsDone(), or block with
+// Wait() until the disk has finished with it.
+//
+// If "toCall" is non-NULL, toCall->CallBack() is also invoked when the
+// request completes.  Note that this happens inside the disk interrupt
+// handler, so the callback must not block (and must not delete the
+// request).
+
+class DiskRequest
+{
+public:
+    DiskRequest(int sectorNumber, char *data, bool writing,
+                CallBackObj *toCall = NULL);
+    // Initialize a request to read
+    // or write "sectorNumber"
+    DiskRequest(int sectorNumber, char *data, int numSectors,
+                bool writing, CallBackObj *toCall = NULL);
+    // ... or "numSectors" sectors,
+    // using one contiguous buffer
+    DiskRequest(int sectorNumber, char **buffers, int numSectors,
+                bool writing, CallBackObj *toCall = NULL);
+    // ... or "numSectors" sectors,
+    // using one buffer per sector
+    DiskRequest(CallBackObj *toCall = NULL);
+    // Initialize a request to flush
+    // the disk's cache
+    ~DiskRequest();
+
+    bool IsDone() { return done; } // Has the disk finished?
+    void Wait();                   // Block until the disk has finished
+
+    int sector;     // The first sector to read/write
+    int numSectors; // Number of consecutive sectors
+                    // (0 for a flush)
+    char **buffers; // The bytes to be written, or the
+                    // buffers to hold the incoming bytes,
+                    // one per sector
+    bool writing;   // Is this a write request?
+
+private:
+    void Init(int sectorNumber, int count, bool isWrite,
+              CallBackObj *toCall);
+
+    bool done;                 // Has the request completed?
+    bool ownBuffers;           // Did we allocate "buffers"?
+    Semaphore *finished;       // Signalled when the request completes
+    CallBackObj *callWhenDone; // Notified when the request completes
+
+    friend class SynchDisk;
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -24,33 +83,62 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Underneath, requests are queued in front of the raw disk,
+// so that threads that do not want to wait can Submit() a request and
+// carry on computing while the disk works on it.
 
 class SynchDisk : public CallBackObj
 {
 public:
-    SynchDisk();  // Initialize a synchronous disk,
-                  // by initializing the raw Disk.
+    SynchDisk(bool format = FALSE, int tracks = DefaultNumTracks,
+              int perTrack = DefaultSectorsPerTrack);
+    // Initialize a synchronous disk,
+    // by initializing the raw Disk
+    // (see Disk::Disk for the arguments).
     ~SynchDisk(); // De-allocate the synch disk data
 
     void ReadSector(int sectorNumber, char *data);
     // Read/write a disk sector, returning
     // only once the data is actually read
-    // or written.  These call
-    // Disk::ReadRequest/WriteRequest and
-    // then wait until the request is done.
+    // or written.  These submit a request
+    // and then wait until the request is done.
     void WriteSector(int sectorNumber, char *data);
 
+    void ReadSectors(int sectorNumber, char *data, int numSectors);
+    void WriteSectors(int sectorNumber, char *data, int numSectors);
+    // Same, for a run of consecutive
+    // sectors, as one disk request
+
+    int NumSectors() { return disk->NumSectors(); }
+    // Size of the disk, in sectors
+
+    void Flush(); // Make sure every request completed so
+                  // far has reached the platter, and the
+                  // simulated disk's backing file
+
+    void SetCache(int segments, bool writeBack);
+    // Configure the disk's on-board cache
+    // (see Disk::SetCache)
+    void SetCrash(int writes);
+    // Crash part way through a later
+    // write (see Disk::SetCrash)
+
+    void Submit(DiskRequest *request);
+    // Queue a request for the disk, and
+    // return immediately.  The request must
+    // not be deleted until it is done.
+
     void CallBack(); // Called by the disk device interrupt
                      // handler, to signal that the
                      // current disk operation is complete.
 
 private:
-    Disk *disk;           // Raw disk device
-    Semaphore *semaphore; // To synchronize requesting thread
-                          // with the interrupt handler
-    Lock *lock;           // Only one read/write request
-                          // can be sent to the disk at a time
+    void StartNext(); // Hand the next queued request to the disk
+
+    Disk *disk;                  // Raw disk device
+    List<DiskRequest *> *queue;  // Requests waiting for the disk
+    DiskRequest *current;        // Request the disk is working on,
+                                 // NULL if the disk is idle
 };
 
 #endif // SYNCHDISK_H
@@ -31,10 +31,25 @@ Bitmap::Bitmap(int numItems)
     {
         map[i] = 0; // initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++)
-    {
-        Clear(i);
-    }
+    Recount();
+}
+
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Recompute the number of clear bits, for when the contents of the
+//	map have been filled in wholesale (eg, read from disk).  The unused
+//	bits at the end of the last word are set, so that the searches
+//	below never stop on them.
+//----------------------------------------------------------------------
+
+void Bitmap::Recount()
+{
+    if (numBits % BitsInWord != 0)
+        map[numWords - 1] |= ~0u << (numBits % BitsInWord);
+    numClear = 0;
+    for (int i = 0; i < numWords; i++)
+        numClear += BitsInWord - __builtin_popcount(map[i]);
+    hint = 0;
 }
 
 //----------------------------------------------------------------------
@@ -58,7 +73,11 @@ void Bitmap::Mark(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (!Test(which))
+    {
+        map[which / BitsInWord] |= 1 << (which % BitsInWord);
+        numClear--;
+    }
 
     ASSERT(Test(which));
 }
@@ -74,7 +93,11 @@ void Bitmap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (Test(which))
+    {
+        map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+        numClear++;
+    }
 
     ASSERT(!Test(which));
 }
@@ -100,48 +123,184 @@ bool Bitmap::Test(int which) const
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::NextClear, Bitmap::NextSet
+// 	Return the number of the first clear (resp. set) bit at or after
+//	"which", or numBits if there is none.  Whole words of set (resp.
+//	clear) bits are skipped at once.
+//
+//	"which" is where to start looking
+//----------------------------------------------------------------------
+
+int Bitmap::NextClear(int which) const
+{
+    int word = which / BitsInWord;
+    unsigned int bits;
+
+    if (which >= numBits)
+        return numBits;
+    bits = ~map[word] & (~0u << (which % BitsInWord));
+    while (bits == 0)
+    {
+        if (++word == numWords)
+            return numBits;
+        bits = ~map[word];
+    }
+    return min(word * BitsInWord + __builtin_ctz(bits), numBits);
+}
+
+int Bitmap::NextSet(int which) const
+{
+    int word = which / BitsInWord;
+    unsigned int bits;
+
+    if (which >= numBits)
+        return numBits;
+    bits = map[word] & (~0u << (which % BitsInWord));
+    while (bits == 0)
+    {
+        if (++word == numWords)
+            return numBits;
+        bits = map[word];
+    }
+    return min(word * BitsInWord + __builtin_ctz(bits), numBits);
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
+// 	Return the number of a bit which is clear.
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
+//	The search is "next fit": it starts from the word where the last
+//	bit was found, and wraps around, so that allocating many bits one
+//	at a time doesn't scan the same full words over and over.
+//
 //	If no bits are clear, return -1.
 //----------------------------------------------------------------------
 
 int Bitmap::FindAndSet()
 {
-    for (int i = 0; i < numBits; i++)
+    if (numClear == 0)
+        return -1;
+    for (int i = 0; i < numWords; i++)
     {
-        if (!Test(i))
+        int word = (hint + i) % numWords;
+
+        if (map[word] != ~0u)
         {
-            Mark(i);
-            return i;
+            int which = word * BitsInWord + __builtin_ctz(~map[word]);
+
+            hint = word;
+            Mark(which);
+            return which;
         }
     }
+    ASSERTNOTREACHED(); // numClear said there was a clear bit
     return -1;
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::FindRun
+// 	Return the number of the first bit of the first run of at least
+//	"length" consecutive clear bits, or -1 if there is no such run.
+//	Nothing is set.
+//
+//	"length" -- the number of bits wanted
 //----------------------------------------------------------------------
 
-int Bitmap::NumClear() const
+int Bitmap::FindRun(int length) const
 {
-    int count = 0;
+    int start, end;
 
-    for (int i = 0; i < numBits; i++)
+    ASSERT(length > 0);
+    if (numClear < length)
+        return -1;
+    for (start = NextClear(0); start < numBits; start = NextClear(end))
     {
-        if (!Test(i))
+        end = NextSet(start);
+        if (end - start >= length)
+            return start;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRun
+// 	Find a run of consecutive clear bits: the first run that is at
+//	least "maxLength" long, or, if there is none, the longest one.
+//	Set the first "maxLength" bits of the run (or all of them, if it
+//	is shorter), and return the number of the first one.
+//
+//	If no bits are clear, return -1.
+//
+//	"maxLength" -- the number of bits wanted
+//	"length" -- set to the number of bits actually allocated
+//----------------------------------------------------------------------
+
+int Bitmap::FindAndSetRun(int maxLength, int *length)
+{
+    int bestStart = -1, bestLength = 0;
+    int start, end;
+
+    ASSERT(maxLength > 0);
+    if (numClear >= maxLength)
+        bestStart = FindRun(maxLength);
+    if (bestStart >= 0)
+        bestLength = maxLength;
+    else
+    { // settle for the longest run there is
+        for (start = NextClear(0); start < numBits; start = NextClear(end))
         {
-            count++;
+            end = NextSet(start);
+            if (end - start > bestLength)
+            {
+                bestStart = start;
+                bestLength = end - start;
+            }
         }
+        bestLength = min(bestLength, maxLength);
     }
+    for (int i = 0; i < bestLength; i++)
+        Mark(bestStart + i);
+    *length = bestLength;
+    return bestStart;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::MarkRun
+// 	Extend an allocated run of bits: set the bits from "start" on, as
+//	long as they are clear, up to "maxLength" of them.  Return the
+//	number of bits set (0 if "start" is already set, or is past the
+//	end of the bitmap).
+//
+//	"start" -- the first bit to set
+//	"maxLength" -- the most bits to set
+//----------------------------------------------------------------------
+
+int Bitmap::MarkRun(int start, int maxLength)
+{
+    int count;
+
+    if (start >= numBits)
+        return 0;
+    count = min(NextSet(start), start + maxLength) - start;
+    for (int i = 0; i < count; i++)
+        Mark(start + i);
     return count;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::NumClear
+// 	Return the number of clear bits in the bitmap.
+//	(In other words, how many bits are unallocated?)
+//----------------------------------------------------------------------
+
+int Bitmap::NumClear() const
+{
+    return numClear;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Print
 // 	Print the contents of the bitmap, for debugging.
@@ -184,6 +343,21 @@ void Bitmap::SelfTest()
     Clear(1);
     Clear(31);
 
+    int length;
+    Mark(2);
+    ASSERT(FindAndSetRun(5, &length) == 3 && length == 5); // skips 0-1
+    ASSERT(FindAndSetRun(2, &length) == 0 && length == 2); // first fit
+    ASSERT(FindRun(3) == 8 && NumClear() == numBits - 8);
+    ASSERT(MarkRun(8, 4) == 4 && FindRun(1) == 12);
+    for (i = 8; i < 12; i++)
+    {
+        Clear(i);
+    }
+    for (i = 0; i < 8; i++)
+    {
+        Clear(i);
+    }
+
     for (i = 0; i < numBits; i++)
     {
         Mark(i);
@@ -3,7 +3,10 @@
 //	can be either on or off.
 //
 //	Represented as an array of unsigned integers, on which we do
-//	modulo arithmetic to find the bit we are interested in.
+//	modulo arithmetic to find the bit we are interested in.  Searches
+//	look at a whole word at a time, skipping words with no clear (or
+//	no set) bits, and the number of clear bits is kept up to date, so
+//	that big bitmaps -- eg, the free map of a big disk -- are cheap.
 //
 //	The bitmap can be parameterized with with the number of bits being
 //	managed.
@@ -35,14 +38,29 @@ class Bitmap
 public:
     Bitmap(int numItems); // Initialize a bitmap, with "numItems" bits
                           // initially, all bits are cleared.
-    ~Bitmap();            // De-allocate bitmap
+    virtual ~Bitmap();    // De-allocate bitmap
 
-    void Mark(int which);       // Set the "nth" bit
-    void Clear(int which);      // Clear the "nth" bit
+    virtual void Mark(int which);  // Set the "nth" bit
+    virtual void Clear(int which); // Clear the "nth" bit
     bool Test(int which) const; // Is the "nth" bit set?
     int FindAndSet();           // Return the # of a clear bit, and as a side
         // effect, set the bit.
         // If no bits are clear, return -1.
+    int FindRun(int length) const;
+        // Return the # of the first bit of
+        // the first run of at least "length"
+        // clear bits, or -1 if there is none
+    int FindAndSetRun(int maxLength, int *length);
+        // Return the # of the first bit of a
+        // run of clear bits, as long as
+        // possible up to "maxLength", and set
+        // the bits.  If no bits are clear,
+        // return -1.
+    int MarkRun(int start, int maxLength);
+        // Set the clear bits from "start" on,
+        // up to "maxLength" of them, stopping
+        // at the first set bit; return how
+        // many were set
     int NumClear() const; // Return the number of clear bits
 
     void Print() const; // Print contents of bitmap
@@ -55,6 +73,14 @@ protected:
                        //  multiple of the number of bits in
                        //  a word)
     unsigned int *map; // bit storage
+    int numClear;      // number of bits that are clear
+    int hint;          // word where FindAndSet starts looking
+
+    void Recount(); // Recompute numClear, after "map" has
+                    // been filled in from outside
+    int NextClear(int which) const; // # of the first clear (set) bit
+    int NextSet(int which) const;   // at or after "which", or numBits
+                                    // if there is none
 };
 
 #endif // BITMAP_H
@@ -32,6 +32,9 @@
 #include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <limits.h>
 #include <cerrno>
 
 #ifdef SOLARIS
@@ -367,6 +370,56 @@ WriteFile(int fd, char *buffer, int nBytes)
     ASSERT(retVal == nBytes);
 }
 
+//----------------------------------------------------------------------
+// ReadVector, WriteVector
+// 	Transfer "count" buffers, each "bufferSize" bytes long, to/from
+//	consecutive bytes of an open file starting at "offset" -- that is,
+//	a scatter read or a gather write.  Done with preadv/pwritev, so a
+//	whole vector costs one system call and leaves the file position
+//	alone.  Abort if the transfer fails.
+//----------------------------------------------------------------------
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+static void
+TransferVector(int fd, char **buffers, int bufferSize, int count,
+	       int offset, bool writing)
+{
+    struct iovec vec[IOV_MAX];
+
+    while (count > 0) {
+	int n = (count < IOV_MAX) ? count : IOV_MAX;
+	int retVal;
+
+	for (int i = 0; i < n; i++) {
+	    vec[i].iov_base = buffers[i];
+	    vec[i].iov_len = bufferSize;
+	}
+	if (writing)
+	    retVal = pwritev(fd, vec, n, offset);
+	else
+	    retVal = preadv(fd, vec, n, offset);
+	ASSERT(retVal == n * bufferSize);
+	buffers += n;
+	count -= n;
+	offset += n * bufferSize;
+    }
+}
+
+void
+ReadVector(int fd, char **buffers, int bufferSize, int count, int offset)
+{
+    TransferVector(fd, buffers, bufferSize, count, offset, FALSE);
+}
+
+void
+WriteVector(int fd, char **buffers, int bufferSize, int count, int offset)
+{
+    TransferVector(fd, buffers, bufferSize, count, offset, TRUE);
+}
+
 //----------------------------------------------------------------------
 // Lseek
 // 	Change the location within an open file.  Abort on error.
@@ -396,6 +449,45 @@ Tell(int fd)
 }
 
 
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "nBytes" of an open file into our address space,
+//	shared, so that stores into the mapping go to the file.  Abort
+//	on error.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int nBytes)
+{
+    void *addr = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Force the modified pages of a mapped file out to the file.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *addr, int nBytes)
+{
+    int retVal = msync(addr, nBytes, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Remove a mapping made by MapFile.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int nBytes)
+{
+    int retVal = munmap(addr, nBytes);
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // Close
 // 	Close a file.  Abort on error.
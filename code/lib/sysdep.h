@@ -48,8 +48,15 @@ extern int OpenForReadWrite(char *name, bool crashOnError);
 extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
+extern void ReadVector(int fd, char **buffers, int bufferSize, int count,
+		       int offset);
+extern void WriteVector(int fd, char **buffers, int bufferSize, int count,
+		       int offset);
 extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
+extern char *MapFile(int fd, int nBytes);
+extern void SyncMappedFile(char *addr, int nBytes);
+extern void UnmapFile(char *addr, int nBytes);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
@@ -21,11 +21,23 @@
 
 // We put a magic number at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file
-// as a disk (which would probably trash the file's contents).
+// as a disk (which would probably trash the file's contents).  The magic
+// number is followed by the disk geometry.
+//
+// Disks made before the geometry was recorded have only the old magic
+// number in front of sector 0; they can still be used, with the default
+// geometry and 128-byte sectors, until they are formatted again.
+
+const int MagicNumber = 0x456789ac;
+const int OldMagicNumber = 0x456789ab;
 
-const int MagicNumber = 0x456789ab;
-const int MagicSize = sizeof(int);
-const int DiskSize = (MagicSize + (NumSectors * SectorSize));
+struct DiskHeader
+{
+    int magicNumber;
+    int sectorSize;
+    int sectorsPerTrack;
+    int numTracks;
+};
 
 //----------------------------------------------------------------------
 // Disk::Disk()
@@ -34,11 +46,15 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"format" -- if TRUE, write a new header with the following geometry
+//		(the sectors themselves are left alone; the file system
+//		is responsible for initializing them)
+//	"tracks", "perTrack" -- geometry for a new or reformatted disk
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool format, int tracks, int perTrack)
 {
-    int magicNum;
+    DiskHeader header;
     int tmp = 0;
 
     DEBUG(dbgDisk, "Initializing the disk.");
@@ -50,19 +66,64 @@ Disk::Disk(CallBackObj *toCall)
     fileno = OpenForReadWrite(diskname, FALSE);
     if (fileno >= 0)
     { // file exists, check magic number
-        Read(fileno, (char *)&magicNum, MagicSize);
-        ASSERT(magicNum == MagicNumber);
+        Read(fileno, (char *)&header.magicNumber, sizeof(int));
+        ASSERT(header.magicNumber == MagicNumber ||
+               header.magicNumber == OldMagicNumber);
     }
     else
     { // file doesn't exist, create it
         fileno = OpenForWrite(diskname);
-        magicNum = MagicNumber;
-        WriteFile(fileno, (char *)&magicNum, MagicSize); // write magic number
+        format = TRUE;
+    }
 
-        // need to write at end of file, so that reads will not return EOF
-        Lseek(fileno, DiskSize - sizeof(int), 0);
+    if (format)
+    {
+        ASSERT(tracks > 0 && perTrack > 0);
+        header.magicNumber = MagicNumber;
+        header.sectorSize = SectorSize;
+        header.sectorsPerTrack = perTrack;
+        header.numTracks = tracks;
+        Lseek(fileno, 0, 0);
+        WriteFile(fileno, (char *)&header, sizeof(DiskHeader));
+    }
+    else if (header.magicNumber == MagicNumber)
+        Read(fileno, (char *)&header.sectorSize, sizeof(DiskHeader) - sizeof(int));
+    else
+    { // old disk, fixed geometry
+        header.sectorSize = 128;
+        header.sectorsPerTrack = DefaultSectorsPerTrack;
+        header.numTracks = DefaultNumTracks;
+    }
+    if (header.sectorSize != SectorSize)
+    {
+        cerr << diskname << " has " << header.sectorSize
+             << "-byte sectors; reformat it with -f\n";
+        ASSERT(FALSE);
+    }
+    numTracks = header.numTracks;
+    sectorsPerTrack = header.sectorsPerTrack;
+    headerSize = (header.magicNumber == MagicNumber) ? sizeof(DiskHeader)
+                                                     : sizeof(int);
+    diskSize = headerSize + NumSectors() * SectorSize;
+    DEBUG(dbgDisk, "Disk geometry: " << numTracks << " tracks, "
+                       << sectorsPerTrack << " sectors per track");
+
+    if (format)
+    { // need to write at end of file, so that reads will not return EOF
+        Lseek(fileno, diskSize - sizeof(int), 0);
         WriteFile(fileno, (char *)&tmp, sizeof(int));
     }
+    cache = NULL;
+    numSegments = 0;
+    writeBack = FALSE;
+    crashCountdown = 0;
+    image = NULL;
+#ifndef NO_DISK_MMAP
+    Lseek(fileno, 0, SEEK_END); // a short file can't be mapped safely
+    ASSERT(Tell(fileno) >= diskSize);
+    image = MapFile(fileno, diskSize);
+    ASSERT(*(int *)image == header.magicNumber);
+#endif
     active = FALSE;
 }
 
@@ -74,9 +135,25 @@ Disk::Disk(CallBackObj *toCall)
 
 Disk::~Disk()
 {
+    SetCache(0, FALSE);
+    if (image != NULL) // like Close, this leaves the data to the host
+        UnmapFile(image, diskSize);
     Close(fileno);
 }
 
+//----------------------------------------------------------------------
+// Disk::Flush()
+// 	Force the sectors written so far out to the UNIX file.  Only the
+//	mapped disk needs this; otherwise every request was already a
+//	UNIX write.
+//----------------------------------------------------------------------
+
+void Disk::Flush()
+{
+    if (image != NULL)
+        SyncMappedFile(image, diskSize);
+}
+
 //----------------------------------------------------------------------
 // Disk::PrintSector()
 // 	Dump the data in a disk read/write request, for debugging.
@@ -115,40 +192,115 @@ PrintSector(bool writing, int sector, char *data)
 
 void Disk::ReadRequest(int sectorNumber, char *data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    Transfer(sectorNumber, &data, 1, FALSE);
+}
+
+void Disk::WriteRequest(int sectorNumber, char *data)
+{
+    Transfer(sectorNumber, &data, 1, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive disk sectors,
+//	scattering them into (or gathering them from) separate buffers.
+//	The UNIX file is accessed with a single vectored system call, and
+//	the caller gets a single interrupt when the whole run is done.
+//	(If the file is mapped, the run is simply copied in or out of
+//	the mapping.)
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"buffers" -- one sector-sized buffer for each sector
+//	"numSectors" -- the number of sectors in the run
+//----------------------------------------------------------------------
+
+void Disk::ReadRequest(int sectorNumber, char **buffers, int numSectors)
+{
+    Transfer(sectorNumber, buffers, numSectors, FALSE);
+}
+
+void Disk::WriteRequest(int sectorNumber, char **buffers, int numSectors)
+{
+    Transfer(sectorNumber, buffers, numSectors, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Disk::Transfer
+// 	Common code for all read and write requests.
+//----------------------------------------------------------------------
+
+void Disk::Transfer(int sectorNumber, char **buffers, int numSectors,
+                    bool writing)
+{
+    int ticks = (cache != NULL) ? CacheLatency(sectorNumber, writing, numSectors)
+                                : ComputeLatency(sectorNumber, writing, numSectors);
+    bool crashing = writing && crashCountdown > 0 && --crashCountdown == 0;
 
     ASSERT(!active); // only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT(numSectors > 0);
+    ASSERT((sectorNumber >= 0) &&
+           (sectorNumber + numSectors <= NumSectors()));
+
+    DEBUG(dbgDisk, (writing ? "Writing to sector " : "Reading from sector ")
+                       << sectorNumber << ", " << numSectors << " sectors");
+    if (crashing)
+        numSectors = (numSectors + 1) / 2; // the rest never get there
+    if (image != NULL)
+    {
+        char *start = image + SectorSize * sectorNumber + headerSize;
 
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+        for (int i = 0; i < numSectors; i++)
+            if (writing)
+                bcopy(buffers[i], start + i * SectorSize, SectorSize);
+            else
+                bcopy(start + i * SectorSize, buffers[i], SectorSize);
+    }
+    else if (writing)
+        WriteVector(fileno, buffers, SectorSize, numSectors,
+                    SectorSize * sectorNumber + headerSize);
+    else
+        ReadVector(fileno, buffers, SectorSize, numSectors,
+                   SectorSize * sectorNumber + headerSize);
+    if (crashing)
+    {
+        Flush();
+        cerr << "Disk: simulated crash writing sector " << sectorNumber << "\n";
+        Exit(1);
+    }
     if (debug->IsEnabled('d'))
-        PrintSector(FALSE, sectorNumber, data);
+        for (int i = 0; i < numSectors; i++)
+            PrintSector(writing, sectorNumber + i, buffers[i]);
 
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskReads++;
+    if (cache == NULL) // else CacheLatency has moved the head
+        UpdateLast(sectorNumber + numSectors - 1);
+    if (writing)
+        kernel->stats->numDiskWrites++;
+    else
+        kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
-void Disk::WriteRequest(int sectorNumber, char *data)
-{
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+//----------------------------------------------------------------------
+// Disk::FlushRequest
+// 	Simulate a request to write every dirty sector in the disk's
+//	cache through to the platter.  Like a read or write request, it
+//	returns immediately, and the caller gets an interrupt when the
+//	disk is done.  With no write-back cache there is nothing to do,
+//	but the request still takes a tick.
+//----------------------------------------------------------------------
 
-    ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+void Disk::FlushRequest()
+{
+    int ticks = 0;
 
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-        PrintSector(TRUE, sectorNumber, data);
+    ASSERT(!active); // only one request at a time
+    for (int i = 0; i < numSegments; i++)
+        ticks += WriteSegment(&cache[i], kernel->stats->totalTicks + ticks);
+    DEBUG(dbgDisk, "Flushing the disk cache, latency = " << ticks);
 
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskWrites++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+    kernel->interrupt->Schedule(this, (ticks > 0) ? ticks : 1, DiskInt);
 }
 
 //----------------------------------------------------------------------
@@ -175,8 +327,8 @@ void Disk::CallBack()
 
 int Disk::TimeToSeek(int newSector, int *rotation)
 {
-    int newTrack = newSector / SectorsPerTrack;
-    int oldTrack = lastSector / SectorsPerTrack;
+    int newTrack = newSector / sectorsPerTrack;
+    int oldTrack = lastSector / sectorsPerTrack;
     int seek = abs(newTrack - oldTrack) * SeekTime;
     // how long will seek take?
     int over = (kernel->stats->totalTicks + seek) % RotationTime;
@@ -197,16 +349,16 @@ int Disk::TimeToSeek(int newSector, int *rotation)
 
 int Disk::ModuloDiff(int to, int from)
 {
-    int toOffset = to % SectorsPerTrack;
-    int fromOffset = from % SectorsPerTrack;
+    int toOffset = to % sectorsPerTrack;
+    int fromOffset = from % sectorsPerTrack;
 
-    return ((toOffset - fromOffset) + SectorsPerTrack) % SectorsPerTrack;
+    return ((toOffset - fromOffset) + sectorsPerTrack) % sectorsPerTrack;
 }
 
 //----------------------------------------------------------------------
 // Disk::ComputeLatency()
-// 	Return how long will it take to read/write a disk sector, from
-//	the current position of the disk head.
+// 	Return how long will it take to read/write a run of disk sectors,
+//	from the current position of the disk head.
 //
 //   	Latency = seek time + rotational latency + transfer time
 //   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
@@ -215,7 +367,9 @@ int Disk::ModuloDiff(int to, int from)
 //   	To find the rotational latency, we first must figure out where the
 //   	disk head will be after the seek (if any).  We then figure out
 //   	how long it will take to rotate completely past newSector after
-//	that point.
+//	that point.  The rest of the run then follows at one sector per
+//	RotationTime, plus a track-to-track seek each time the run moves
+//	on to the next track.
 //
 //   	The disk also has a "track buffer"; the disk continuously reads
 //   	the contents of the current disk track into the buffer.  This allows
@@ -224,25 +378,267 @@ int Disk::ModuloDiff(int to, int from)
 //   	a new track.
 //----------------------------------------------------------------------
 
-int Disk::ComputeLatency(int newSector, bool writing)
+int Disk::ComputeLatency(int newSector, bool writing, int numSectors)
 {
+#ifndef NOTRACKBUF // turn this on if you don't want the track buffer stuff
     int rotation;
     int seek = TimeToSeek(newSector, &rotation);
     int timeAfter = kernel->stats->totalTicks + seek + rotation;
+    int endSector = newSector + numSectors - 1;
+    int trackSwitches = endSector / sectorsPerTrack - newSector / sectorsPerTrack;
 
-#ifndef NOTRACKBUF // turn this on if you don't want the track buffer stuff
-    // check if track buffer applies
-    if ((writing == FALSE) && (seek == 0) && (((timeAfter - bufferInit) / RotationTime) > ModuloDiff(newSector, bufferInit / RotationTime)))
+    // check if track buffer applies to every sector in the run
+    if ((writing == FALSE) && (seek == 0) && (trackSwitches == 0))
     {
-        DEBUG(dbgDisk, "Request latency = " << RotationTime);
-        return RotationTime; // time to transfer sector from the track buffer
+        int i;
+        for (i = newSector; i <= endSector; i++)
+            if (((timeAfter - bufferInit) / RotationTime) <= ModuloDiff(i, bufferInit / RotationTime))
+                break;
+        if (i > endSector)
+        {
+            DEBUG(dbgDisk, "Request latency = " << numSectors * RotationTime);
+            return numSectors * RotationTime; // transfer from the track buffer
+        }
     }
 #endif
 
-    rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+    int latency = MediaLatency(newSector, numSectors, kernel->stats->totalTicks);
+
+    DEBUG(dbgDisk, "Request latency = " << latency);
+    return latency;
+}
+
+//----------------------------------------------------------------------
+// Disk::MediaLatency()
+// 	Return how long it will take the head to get from lastSector to
+//	newSector, starting at time "when", and then to transfer a run of
+//	"numSectors" sectors: seek time + rotational latency + transfer
+//	time, with no help from the track buffer or cache.
+//----------------------------------------------------------------------
+
+int Disk::MediaLatency(int newSector, int numSectors, int when)
+{
+    int newTrack = newSector / sectorsPerTrack;
+    int oldTrack = lastSector / sectorsPerTrack;
+    int seek = abs(newTrack - oldTrack) * SeekTime;
+    int over = (when + seek) % RotationTime;
+    int rotation = (over > 0) ? RotationTime - over : 0;
+    int endSector = newSector + numSectors - 1;
+    int trackSwitches = endSector / sectorsPerTrack - newTrack;
+    int transfer = numSectors * RotationTime + trackSwitches * SeekTime;
+
+    rotation += ModuloDiff(newSector, (when + seek + rotation) / RotationTime) * RotationTime;
+    return (seek + rotation + transfer);
+}
+
+//----------------------------------------------------------------------
+// Disk::SetCache()
+// 	Replace the track buffer with a segmented cache on the disk
+//	controller (or go back to the track buffer, if "segments" is 0).
+//	Any dirty sectors in the old cache are considered written.
+//
+//	"segments" -- number of tracks the cache can hold
+//	"writeBack" -- TRUE if writes may stay in the cache
+//----------------------------------------------------------------------
+
+void Disk::SetCache(int segments, bool writeBack)
+{
+    for (int i = 0; i < numSegments; i++)
+    {
+        delete[] cache[i].ready;
+        delete[] cache[i].dirty;
+    }
+    delete[] cache;
+    cache = NULL;
+    numSegments = segments;
+    this->writeBack = writeBack;
+    if (segments == 0)
+        return; // (also called from ~Disk, after the statistics are gone)
+
+    kernel->stats->diskCacheUsed = TRUE;
+
+    cache = new CacheSegment[segments];
+    for (int i = 0; i < segments; i++)
+    {
+        cache[i].track = -1;
+        cache[i].lastUse = 0;
+        cache[i].ready = new int[sectorsPerTrack];
+        cache[i].dirty = new bool[sectorsPerTrack];
+    }
+}
+
+//----------------------------------------------------------------------
+// Disk::SetCrash()
+// 	Simulate a power failure during a later write request: only the
+//	first half of its sectors (rounded up) are written, and then
+//	Nachos exits at once, without writing anything back.  Used to
+//	test that the file system recovers from a crash.
+//
+//	"writes" -- which write request, counting from now, fails
+//----------------------------------------------------------------------
+
+void Disk::SetCrash(int writes)
+{
+    crashCountdown = writes;
+}
+
+//----------------------------------------------------------------------
+// Disk::FindSegment()
+// 	Return the cache segment holding "track", or NULL if there isn't
+//	one.  If "allocate", make one instead, by replacing the least
+//	recently used segment; if it was holding dirty sectors, they are
+//	written to the platter first, and the time that takes is added
+//	to "*extra".
+//----------------------------------------------------------------------
 
-    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
-    return (seek + rotation + RotationTime);
+Disk::CacheSegment *
+Disk::FindSegment(int track, bool allocate, int *extra)
+{
+    int now = kernel->stats->totalTicks;
+    CacheSegment *victim = &cache[0];
+
+    for (int i = 0; i < numSegments; i++)
+    {
+        if (cache[i].track == track)
+        {
+            cache[i].lastUse = now;
+            return &cache[i];
+        }
+        if (cache[i].lastUse < victim->lastUse)
+            victim = &cache[i];
+    }
+    if (!allocate)
+        return NULL;
+
+    DEBUG(dbgDisk, "Disk cache: track " << track << " replaces " << victim->track);
+    *extra += WriteSegment(victim, now + *extra);
+    victim->track = track;
+    victim->lastUse = now;
+    for (int i = 0; i < sectorsPerTrack; i++)
+    {
+        victim->ready[i] = -1;
+        victim->dirty[i] = FALSE;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Disk::WriteSegment()
+// 	Write the dirty sectors of a cache segment to the platter, as one
+//	run from the first dirty sector to the last, starting at time
+//	"when".  Returns how long that takes, and moves the head.
+//----------------------------------------------------------------------
+
+int Disk::WriteSegment(CacheSegment *segment, int when)
+{
+    int first = -1, last = -1;
+    int latency;
+
+    for (int i = 0; i < sectorsPerTrack; i++)
+        if (segment->track >= 0 && segment->dirty[i])
+        {
+            if (first < 0)
+                first = i;
+            last = i;
+            segment->dirty[i] = FALSE;
+        }
+    if (first < 0)
+        return 0;
+
+    first += segment->track * sectorsPerTrack;
+    last += segment->track * sectorsPerTrack;
+    latency = MediaLatency(first, last - first + 1, when);
+    lastSector = last;
+    return latency;
+}
+
+//----------------------------------------------------------------------
+// Disk::CacheLatency()
+// 	Return how long a request will take when the disk has a cache,
+//	and update the cache (and the position of the head) to reflect
+//	the request.
+//
+//	A read that finds all of its sectors in the cache costs just the
+//	transfer time (plus, if the read-ahead has not got that far yet,
+//	the time until it does).  Otherwise, the read goes to the platter,
+//	and the rest of the last track is read ahead into the cache as it
+//	passes under the head.
+//
+//	In write-back mode, a write costs only the transfer time into the
+//	cache, plus the cost of writing back any segment it displaces.  In
+//	write-through mode, a write goes to the platter and updates any
+//	cached copy.
+//----------------------------------------------------------------------
+
+int Disk::CacheLatency(int newSector, bool writing, int numSectors)
+{
+    int now = kernel->stats->totalTicks;
+    int endSector = newSector + numSectors - 1;
+    int extra = 0; // time spent writing back displaced segments
+    int latency, done;
+    CacheSegment *segment;
+    int i;
+
+    if (!writing)
+    {
+        int wait = 0;
+
+        for (i = newSector; i <= endSector; i++)
+        {
+            segment = FindSegment(i / sectorsPerTrack, FALSE, NULL);
+            if (segment == NULL || segment->ready[i % sectorsPerTrack] < 0)
+                break;
+            wait = max(wait, segment->ready[i % sectorsPerTrack] - now);
+        }
+        if (i > endSector)
+        {
+            kernel->stats->numDiskCacheHits++;
+            latency = wait + numSectors * RotationTime;
+            DEBUG(dbgDisk, "Request latency = " << latency << " (cache hit)");
+            return latency;
+        }
+        kernel->stats->numDiskCacheMisses++;
+    }
+
+    if (writing && writeBack)
+    {
+        for (i = newSector; i <= endSector; i++)
+        {
+            segment = FindSegment(i / sectorsPerTrack, TRUE, &extra);
+            segment->ready[i % sectorsPerTrack] = now;
+            segment->dirty[i % sectorsPerTrack] = TRUE;
+        }
+        latency = extra + numSectors * RotationTime;
+        DEBUG(dbgDisk, "Request latency = " << latency << " (write-back)");
+        return latency;
+    }
+
+    // to the platter; reads make room in the cache first
+    if (!writing)
+        for (i = newSector; i <= endSector; i += sectorsPerTrack - i % sectorsPerTrack)
+            FindSegment(i / sectorsPerTrack, TRUE, &extra);
+    latency = extra + MediaLatency(newSector, numSectors, now + extra);
+    done = now + latency;
+    lastSector = endSector;
+
+    for (i = newSector; i <= endSector; i++)
+    {
+        segment = FindSegment(i / sectorsPerTrack, FALSE, NULL);
+        if (segment == NULL)
+            continue;
+        if (writing || segment->ready[i % sectorsPerTrack] < 0)
+            segment->ready[i % sectorsPerTrack] = done - (endSector - i) * RotationTime;
+        if (writing)
+            segment->dirty[i % sectorsPerTrack] = FALSE;
+    }
+    segment = FindSegment(endSector / sectorsPerTrack, FALSE, NULL);
+    if (!writing && segment != NULL)
+        for (i = endSector + 1; i % sectorsPerTrack != 0; i++)
+            if (segment->ready[i % sectorsPerTrack] < 0)
+                segment->ready[i % sectorsPerTrack] = done + (i - endSector) * RotationTime;
+
+    DEBUG(dbgDisk, "Request latency = " << latency);
+    return latency;
 }
 
 //----------------------------------------------------------------------
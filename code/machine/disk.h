@@ -28,6 +28,10 @@
 //
 // Addressing is by sector number -- each sector on the disk is given
 // a unique number: track * SectorsPerTrack + offset within a track.
+// A request can cover a run of consecutive sectors; it then costs one
+// seek and rotational delay, followed by the sectors passing under the
+// head one after another (plus a track-to-track seek whenever the run
+// crosses into the next track).
 //
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -46,18 +50,55 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// Alternatively, the disk can be given a more realistic controller cache
+// (SetCache): a number of track-sized segments, replaced LRU.  A read
+// that misses brings in the requested sectors plus the rest of their
+// track (read-ahead); a read that finds every sector in the cache costs
+// only the transfer time.  In write-back mode, writes go to the cache
+// and reach the platter only when their segment is evicted, or when a
+// flush is requested.  The cache only models timing -- the UNIX file
+// always holds the latest data.
+//
+// To keep the simulation cheap on the host, the UNIX file is mapped into
+// memory once, and sector transfers are just memory copies; Flush()
+// forces the copies out to the file.  Compile with -DNO_DISK_MMAP to
+// go back to one UNIX read/write per request.
+//
+// To test crash recovery, the disk can also be told to lose power part
+// way through a write request (SetCrash): only the first half of the
+// request's sectors reach the UNIX file, and Nachos stops on the spot.
 
-const int SectorSize = 128;		// number of bytes per disk sector
-const int SectorsPerTrack  = 32;	// number of sectors per disk track 
-const int NumTracks = 32;		// number of tracks per disk
-const int NumSectors = (SectorsPerTrack * NumTracks);
-					// total # of sectors per disk
+//
+// The number of tracks and the number of sectors per track are chosen
+// when the disk is formatted, and recorded in a header at the front of
+// the UNIX file, so a disk can be as large as we like.  The sector size
+// fixes the layout of on-disk data structures (eg, file headers), so it
+// is chosen when Nachos is compiled (-DSECTOR_SIZE=n); it is also
+// recorded in the header, so that a disk is never used by a Nachos
+// compiled for another sector size.
+
+#ifndef SECTOR_SIZE
+#define SECTOR_SIZE 128
+#endif
+
+const int SectorSize = SECTOR_SIZE;	// number of bytes per disk sector
+const int DefaultSectorsPerTrack = 32;	// number of sectors per disk track,
+					// unless chosen at format time
+const int DefaultNumTracks = 32;	// number of tracks per disk, ditto
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool format = FALSE,
+	 int tracks = DefaultNumTracks,
+	 int perTrack = DefaultSectorsPerTrack);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "format", (re)initialize the
+					// disk with the given geometry;
+					// otherwise use the geometry recorded
+					// on the disk.
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
@@ -67,10 +108,40 @@ class Disk : public CallBackObj {
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
 
+    void ReadRequest(int sectorNumber, char **buffers, int numSectors);
+    void WriteRequest(int sectorNumber, char **buffers, int numSectors);
+    					// Read/write "numSectors" consecutive
+					// sectors starting at sectorNumber,
+					// into/out of a vector of sector-sized
+					// buffers (scatter/gather).  The
+					// whole vector is a single request,
+					// with a single interrupt.
+
+    void FlushRequest();		// Write dirty sectors in the disk's
+					// cache to the platter; like a read
+					// or write, this returns immediately
+					// and causes an interrupt later.
+
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
 
-    int ComputeLatency(int newSector, bool writing);	
+    void SetCache(int segments, bool writeBack);
+					// Use a cache of "segments" tracks,
+					// instead of the track buffer; 0 to
+					// go back to the track buffer
+
+    void SetCrash(int writes);		// Crash part way through the
+					// "writes"th write request from now
+
+    void Flush();			// Make sure everything written so far
+					// has reached the UNIX file
+
+    int NumTracks() { return numTracks; }
+    int SectorsPerTrack() { return sectorsPerTrack; }
+    int NumSectors() { return numTracks * sectorsPerTrack; }
+					// Disk geometry
+
+    int ComputeLatency(int newSector, bool writing, int numSectors = 1);
     					// Return how long a request to 
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
@@ -78,12 +149,44 @@ class Disk : public CallBackObj {
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *image;			// the UNIX file, mapped into memory
+					// (NULL if not mapped)
+    int numTracks;			// number of tracks on the disk
+    int sectorsPerTrack;		// number of sectors on each track
+    int headerSize;			// bytes in front of sector 0 in the
+					// UNIX file
+    int diskSize;			// size of the whole UNIX file
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
     int bufferInit;			// When the track buffer started 
 					// being loaded
 
+    struct CacheSegment {		// one track's worth of the disk cache
+	int track;			// which track, -1 if unused
+	int lastUse;			// when last used, for LRU
+	int *ready;			// when each sector became (or will
+					// become) valid; -1 if not cached
+	bool *dirty;			// which sectors must still be written
+    };
+    CacheSegment *cache;		// the disk cache, NULL if none
+    int numSegments;			// number of segments in the cache
+    bool writeBack;			// write-back, or write-through?
+    int crashCountdown;			// write requests left until the
+					// simulated crash, 0 if none
+
+    void Transfer(int sectorNumber, char **buffers, int numSectors,
+		bool writing);		// start a request of either kind
+    int CacheLatency(int newSector, bool writing, int numSectors);
+					// like ComputeLatency, but using the
+					// cache; updates the cache and head
+    CacheSegment *FindSegment(int track, bool allocate, int *extra);
+					// cache segment holding "track"
+    int WriteSegment(CacheSegment *segment, int when);
+					// write a segment's dirty sectors
+    int MediaLatency(int newSector, int numSectors, int when);
+					// time for the head to get to, and
+					// then transfer, a run of sectors
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
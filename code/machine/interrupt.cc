@@ -253,8 +253,7 @@ void Interrupt::Halt()
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
-    delete debug;
-
+    // "debug" stays: the kernel still uses it while shutting down
     delete kernel; // Never returns.
 }
 
@@ -20,6 +20,12 @@ Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    numDiskCacheHits = numDiskCacheMisses = 0;
+    diskCacheUsed = FALSE;
+    numBufferCacheHits = numBufferCacheMisses = 0;
+    numBufferCachePrefetches = 0;
+    numDentryCacheHits = numDentryCacheMisses = 0;
+    numJournalCommits = numJournalSectors = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 }
@@ -37,6 +43,17 @@ Statistics::Print()
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
     cout << "Disk I/O: reads " << numDiskReads;
 		cout << ", writes " << numDiskWrites << "\n";
+    if (diskCacheUsed) {
+	cout << "Disk cache: hits " << numDiskCacheHits;
+		cout << ", misses " << numDiskCacheMisses << "\n";
+    }
+    cout << "Buffer cache: hits " << numBufferCacheHits;
+		cout << ", misses " << numBufferCacheMisses;
+		cout << ", read ahead " << numBufferCachePrefetches << "\n";
+    cout << "Dentry cache: hits " << numDentryCacheHits;
+		cout << ", misses " << numDentryCacheMisses << "\n";
+    cout << "Journal: commits " << numJournalCommits;
+		cout << ", sectors logged " << numJournalSectors << "\n";
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
@@ -30,6 +30,23 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskCacheHits;	// number of disk read requests served
+				// from the disk's on-board cache
+    int numDiskCacheMisses;	// number that had to go to the platter
+    bool diskCacheUsed;		// has the disk had such a cache (-dc)?
+    int numBufferCacheHits;	// number of sectors the file system
+				// found in its buffer cache
+    int numBufferCacheMisses;	// number it did not, or had to wait
+				// for
+    int numBufferCachePrefetches; // number it read ahead, before they
+				// were asked for
+    int numDentryCacheHits;	// number of names the file system
+				// found in its dentry cache
+    int numDentryCacheMisses;	// number it had to look up in the
+				// directory
+    int numJournalCommits;	// number of transactions the file
+				// system committed to its journal
+    int numJournalSectors;	// number of sectors they took in the log
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
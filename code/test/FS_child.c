@@ -0,0 +1,25 @@
+#include "syscall.h"
+
+// is "s" the string "t"?
+int same(char *s, char *t)
+{
+	while (*s == *t && *s != '\0')
+	{
+		++s;
+		++t;
+	}
+	return *s == *t;
+}
+
+int main(int argc, char **argv)
+{
+	// started by FS_test5: exit with a status that tells it what
+	// arguments got here -- argc, plus 10 if argv[0] is this program's
+	// name, plus 100 if argv[1] is "hello"
+	int status = argc;
+	if (same(argv[0], "/FS_child"))
+		status += 10;
+	if (argc > 1 && same(argv[1], "hello"))
+		status += 100;
+	Exit(status);
+}
@@ -0,0 +1,59 @@
+# Crash the disk part way through an operation that changes many sectors
+# -- at its 1st write request, then its 2nd, and so on, until it gets to
+# finish -- and check that after recovery the operation happened either
+# entirely or not at all, and that the file system still works.  (Copying
+# a file is several operations -- a create, then one for each write that
+# grows the file -- so it may stop in between; it isn't tried here.)
+N=../build.linux/nachos
+
+# what the operation changes: the names, and which sectors are in use
+state() {
+	$N -lr / | grep '\['
+	$N -D | grep -A1 "Bitmap set"
+}
+
+setup() {
+	$N -f > /dev/null
+	$N -mkdir /t0 > /dev/null
+	$N -mkdir /t0/aa > /dev/null
+	$N -cp num_100.txt /t0/f1 > /dev/null
+	$N -cp num_1000.txt /t0/aa/f2 > /dev/null
+	$N -mkdir /t1 > /dev/null
+	$N -cp num_100.txt /t1/f3 > /dev/null
+}
+
+# try "$@" crashing at each write in turn; the state after recovery
+# must be the one from before it, or the one from after it
+crash() {
+	setup
+	before=`state`
+	$N "$@" > /dev/null
+	after=`state`
+	n=1
+	while :
+	do
+		setup
+		if $N -crash $n "$@" 2>&1 | grep -q "simulated crash"
+		then
+			crashed=yes
+		else
+			crashed=no
+		fi
+		now=`state`
+		if [ "$now" != "$before" ] && [ "$now" != "$after" ]
+		then
+			echo "FAILED: $* crashing at write $n left"
+			echo "$now"
+		fi
+		$N -p /t1/f3 | cmp -s - num_100.txt || echo "FAILED: $* crashing at write $n lost /t1/f3"
+		$N -cp num_1000.txt /t1/new > /dev/null
+		$N -p /t1/new | cmp -s - num_1000.txt || echo "FAILED: $* crashing at write $n broke the free map"
+		[ $crashed = no ] && break
+		n=`expr $n + 1`
+	done
+	echo "$*: crashed at writes 1 to `expr $n - 1`"
+}
+
+crash -mkdir /t0/bb
+crash -rr /t0
+crash -r /t0/aa/f2
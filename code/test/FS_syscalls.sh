@@ -0,0 +1,9 @@
+make
+../build.linux/nachos -f
+../build.linux/nachos -cp FS_test3 /FS_test3
+../build.linux/nachos -e /FS_test3
+../build.linux/nachos -cp FS_test4 /FS_test4
+../build.linux/nachos -e /FS_test4
+../build.linux/nachos -cp FS_child /FS_child
+../build.linux/nachos -cp FS_test5 /FS_test5
+../build.linux/nachos -e /FS_test5
@@ -0,0 +1,93 @@
+#include "syscall.h"
+
+int main(void)
+{
+	// positional and vectored I/O, and Sync
+	char head[] = "0123456789";
+	char tail[] = "abcdefghijklmnopqrstuvwxyz";
+	char part1[4], part2[6], buf[26];
+	IoVec iov[2];
+	OpenFileId fid;
+	int count, success, i;
+	success = Create("/file3", 0);
+	if (success != 1)
+		MSG("Failed on creating file");
+	fid = Open("/file3");
+	if (fid < 0)
+		MSG("Failed on opening file");
+
+	// write the end first, then the start, out of order
+	count = PWrite(tail, 26, 10, fid);
+	if (count != 26)
+		MSG("Failed on PWrite at 10");
+	count = PWrite(head, 10, 0, fid);
+	if (count != 10)
+		MSG("Failed on PWrite at 0");
+	count = PRead(buf, 26, 10, fid);
+	if (count != 26)
+		MSG("Failed on PRead at 10");
+	for (i = 0; i < 26; ++i)
+	{
+		if (buf[i] != tail[i])
+			MSG("Failed: PRead wrong result");
+	}
+	count = PRead(buf, 10, 36, fid);
+	if (count != 0)
+		MSG("Failed: PRead past the end");
+	count = PRead(buf, 10, -1, fid);
+	if (count != -1)
+		MSG("Failed: PRead at a negative position");
+
+	// PWrite and PRead didn't move the file position, so ReadV starts
+	// at 0; WriteV then carries on where it left off
+	iov[0].buffer = part1;
+	iov[0].size = 4;
+	iov[1].buffer = part2;
+	iov[1].size = 6;
+	count = ReadV(iov, 2, fid);
+	if (count != 10)
+		MSG("Failed on ReadV");
+	for (i = 0; i < 4; ++i)
+	{
+		if (part1[i] != head[i])
+			MSG("Failed: ReadV wrong result in first buffer");
+	}
+	for (i = 0; i < 6; ++i)
+	{
+		if (part2[i] != head[4 + i])
+			MSG("Failed: ReadV wrong result in second buffer");
+	}
+	iov[0].buffer = tail + 20;
+	iov[0].size = 6;
+	iov[1].buffer = head;
+	iov[1].size = 4;
+	count = WriteV(iov, 2, fid);
+	if (count != 10)
+		MSG("Failed on WriteV");
+	count = PRead(buf, 10, 10, fid);
+	if (count != 10)
+		MSG("Failed on PRead after WriteV");
+	for (i = 0; i < 6; ++i)
+	{
+		if (buf[i] != tail[20 + i])
+			MSG("Failed: WriteV wrong result in first buffer");
+	}
+	for (i = 0; i < 4; ++i)
+	{
+		if (buf[6 + i] != head[i])
+			MSG("Failed: WriteV wrong result in second buffer");
+	}
+	count = ReadV(iov, MaxIoVecs + 1, fid);
+	if (count != -1)
+		MSG("Failed: ReadV with too many buffers");
+
+	Sync();
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+	count = PRead(buf, 10, 0, fid);
+	if (count != -1)
+		MSG("Failed: PRead on a closed file");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,80 @@
+#include "syscall.h"
+
+int main(void)
+{
+	// mapped files: more of the file than fits in memory at once, so
+	// pages get evicted, and written back, along the way
+	char head[] = "0123456789";
+	char buf[10];
+	char *map;
+	int length = 25600;
+	OpenFileId fid;
+	int count, success, i;
+	success = Create("/file4", 0);
+	if (success != 1)
+		MSG("Failed on creating file");
+	fid = Open("/file4");
+	if (fid < 0)
+		MSG("Failed on opening file");
+	count = Write(head, 10, fid);
+	if (count != 10)
+		MSG("Failed on writing file");
+
+	map = Mmap(fid, length);
+	if (map == 0)
+		MSG("Failed on mapping file");
+	// the mapping holds the file open
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+	for (i = 0; i < 10; ++i)
+	{
+		if (map[i] != head[i])
+			MSG("Failed: mapping doesn't read the file");
+	}
+	if (map[10] != 0 || map[length - 1] != 0)
+		MSG("Failed: mapping past the end of the file isn't zero");
+
+	// write a byte every 100 (at least one on each page), then read
+	// them all back through the mapping
+	for (i = 10; i < length; i += 100)
+		map[i] = 'a' + i % 26;
+	for (i = 10; i < length; i += 100)
+	{
+		if (map[i] != 'a' + i % 26)
+			MSG("Failed: mapping wrong result");
+	}
+	success = Munmap(map);
+	if (success != 1)
+		MSG("Failed on unmapping file");
+	success = Munmap(map);
+	if (success != -1)
+		MSG("Failed: unmapping twice");
+
+	// every change reached the file
+	fid = Open("/file4");
+	if (fid < 0)
+		MSG("Failed on reopening file");
+	count = Read(buf, 10, fid);
+	if (count != 10)
+		MSG("Failed on reading file");
+	for (i = 0; i < 10; ++i)
+	{
+		if (buf[i] != head[i])
+			MSG("Failed: file start changed");
+	}
+	for (i = 10; i < length; i += 100)
+	{
+		count = PRead(buf, 1, i, fid);
+		if (count != 1 || buf[0] != 'a' + i % 26)
+			MSG("Failed: change through the mapping lost");
+	}
+	success = Close(fid);
+	if (success != 1)
+		MSG("Failed on closing file");
+	map = Mmap(fid, length);
+	if (map != 0)
+		MSG("Failed: mapping a closed file");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,41 @@
+#include "syscall.h"
+
+int main(void)
+{
+	// Exec, ExecV and Join: FS_child exits with a status that says
+	// which arguments it got
+	char *argv[3];
+	SpaceId id, id2;
+	int status;
+	argv[0] = "/FS_child";
+	argv[1] = "hello";
+	argv[2] = 0;
+	id = ExecV(2, argv);
+	if (id < 0)
+		MSG("Failed on ExecV");
+	id2 = Exec("/FS_child");
+	if (id2 < 0)
+		MSG("Failed on Exec");
+	if (id2 == id)
+		MSG("Failed: two programs with the same SpaceId");
+
+	// join them in the opposite order to the one they were started in
+	status = Join(id2);
+	if (status != 11)
+		MSG("Failed: Exec'd program got the wrong arguments");
+	status = Join(id);
+	if (status != 112)
+		MSG("Failed: ExecV'd program got the wrong arguments");
+	status = Join(id);
+	if (status != -1)
+		MSG("Failed: joining twice");
+
+	id = Exec("/no_such_program");
+	if (id != -1)
+		MSG("Failed: Exec of a missing program");
+	id = ExecV(0, argv);
+	if (id != -1)
+		MSG("Failed: ExecV with no arguments");
+	MSG("Passed! ^_^");
+	Halt();
+}
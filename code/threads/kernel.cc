@@ -15,6 +15,10 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "frametable.h"
+#include "processtable.h"
 #include "post.h"
 #include "synchconsole.h"
 
@@ -26,12 +30,22 @@
 
 Kernel::Kernel(int argc, char **argv)
 {
+#ifndef FILESYS_STUB
+    bool geometryFlag = FALSE;	// was -dg given?
+#endif
+
     randomSlice = FALSE; 
     debugUserProg = FALSE;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
+    diskCacheSegments = 0;     // default is the plain track buffer
+    diskWriteBack = FALSE;
+    cacheBuffers = DefaultCacheBuffers;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    diskTracks = DefaultNumTracks;
+    diskSectorsPerTrack = DefaultSectorsPerTrack;
+    diskCrashWrites = 0;
 #endif
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
@@ -60,9 +74,33 @@ Kernel::Kernel(int argc, char **argv)
 	    	ASSERT(i + 1 < argc);
 	    	consoleOut = argv[i + 1];
 	    	i++;
+		} else if (strcmp(argv[i], "-dc") == 0) {
+	    	ASSERT(i + 1 < argc);	// number of tracks in the disk cache
+	    	diskCacheSegments = atoi(argv[i + 1]);
+	    	i++;
+		} else if (strcmp(argv[i], "-dw") == 0) {
+	    	diskWriteBack = TRUE;
+		} else if (strcmp(argv[i], "-bc") == 0) {
+	    	ASSERT(i + 1 < argc);	// number of sectors in the buffer cache
+	    	cacheBuffers = atoi(argv[i + 1]);
+	    	i++;
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+		} else if (strcmp(argv[i], "-dg") == 0) {
+	    	ASSERT(i + 2 < argc);	// number of tracks, sectors per track
+	    	diskTracks = atoi(argv[i + 1]);
+	    	diskSectorsPerTrack = atoi(argv[i + 2]);
+	    	if (diskTracks <= 0 || diskSectorsPerTrack <= 0) {
+		    cerr << "-dg: the numbers of tracks and of sectors per track must be positive\n";
+		    Exit(1);
+	    	}
+	    	geometryFlag = TRUE;
+	    	i += 2;
+		} else if (strcmp(argv[i], "-crash") == 0) {
+	    	ASSERT(i + 1 < argc);	// number of write requests
+	    	diskCrashWrites = atoi(argv[i + 1]);
+	    	i++;
 #endif
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
@@ -76,12 +114,22 @@ Kernel::Kernel(int argc, char **argv)
             cout << "Partial usage: nachos [-rs randomSeed]\n";
 	   		cout << "Partial usage: nachos [-s]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
+            cout << "Partial usage: nachos [-dc cacheTracks] [-dw] [-bc cacheSectors]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-f -dg numTracks sectorsPerTrack]\n";
+	    	cout << "Partial usage: nachos [-crash numWrites]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
 		}
     }
+#ifndef FILESYS_STUB
+    if (geometryFlag && !formatFlag) {
+	// an existing disk keeps the geometry in its header
+	cerr << "-dg only applies to a disk being formatted; use it with -f\n";
+	Exit(1);
+    }
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -99,7 +147,7 @@ Kernel::Initialize()
     // object to save its state. 
 
 	
-    currentThread = new Thread("main", threadNum++);		
+    currentThread = new Thread("main", 0);		
     currentThread->setStatus(RUNNING);
 
     stats = new Statistics();		// collect statistics
@@ -107,14 +155,25 @@ Kernel::Initialize()
     scheduler = new Scheduler();	// initialize the ready queue
     alarm = new Alarm(randomSlice);	// start up time slicing
     machine = new Machine(debugUserProg);
+    frameTable = new FrameTable(NumPhysPages);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
 #ifdef FILESYS_STUB
+    synchDisk = new SynchDisk();    //
+    bufferCache = NULL;
+    inodeTable = NULL;
     fileSystem = new FileSystem();
 #else
-    fileSystem = new FileSystem(formatFlag);
+    synchDisk = new SynchDisk(formatFlag, diskTracks, diskSectorsPerTrack);
+    if (diskCacheSegments > 0)
+        synchDisk->SetCache(diskCacheSegments, diskWriteBack);
+    if (diskCrashWrites > 0)
+        synchDisk->SetCrash(diskCrashWrites);
+    bufferCache = new BufferCache(max(cacheBuffers, MinCacheBuffers));
+    inodeTable = new InodeTable(InodeTableSize);
+    fileSystem = new FileSystem(formatFlag, synchDisk->NumSectors());
 #endif // FILESYS_STUB
+    processTable = new ProcessTable(ProcessTableSize);
 
 	// MP4 mod tag
     /*
@@ -146,15 +205,21 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+    // first, since closing the file system's files takes locks
+    delete fileSystem;
+    delete inodeTable;
+    delete bufferCache;
+    delete processTable;
+
     delete stats;
     delete interrupt;
     delete scheduler;
     delete alarm;
     delete machine;
+    delete frameTable;
     delete synchConsoleIn;
     delete synchConsoleOut;
     delete synchDisk;
-    delete fileSystem;
 	
 	// Mp4 mod tag
 	/*
@@ -274,14 +339,252 @@ Kernel::NetworkTest() {
     // Then we're done!
 }
 
-void ForkExecute(Thread *t)
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// Kernel::FileSystemTest
+//      Stress test the file system with several threads at once, best
+//	run with -rs, so that they are switched at random points.  Each
+//	thread, over a number of rounds:
+//
+//	1. writes a file of its own, in its own directory, in pieces
+//	2. writes a file into a directory every thread uses, and removes
+//	   the one it wrote there two rounds ago (others may still be
+//	   reading it)
+//	3. reads what the next thread wrote there, a few times, in
+//	   whatever state it is in -- missing, or partly or completely
+//	   written
+//	4. reads a file all the threads read at once
+//	5. makes a directory with a file in it, looks into the one the
+//	   next thread makes (which may be being removed), and removes
+//	   its own again
+//
+// When they are all done, everything left is checked, and removed;
+// then every sector the test used must be free again.
+//----------------------------------------------------------------------
+
+static const int FsTestThreads = 4;
+static const int FsTestRounds = 10;
+static const int FsTestCommonLength = 3000;
+static const int FsTestPiece = 100;	// bytes written at a time
+static const int FsTestPolls = 10;	// reads of another's file a round
+
+static Semaphore *fsTestDone;	// V'ed by each thread when it is done
+static int fsTestErrors;
+
+// Byte "offset" of what thread "id" writes in round "round"; the common
+// file is written by "thread" FsTestThreads, round 0
+static char
+FsTestByte(int id, int round, int offset)
+{
+    return 'a' + (id * 7 + round * 3 + offset) % 26;
+}
+
+// The length of what thread "id" writes in round "round", some more
+// than a sector or two
+static int
+FsTestLength(int id, int round)
+{
+    return 40 + (id * 131 + round * 97) % 700;
+}
+
+// Write what thread "id" writes in round "round" to "name", which is
+// created first; a piece at a time, so that others can find it half
+// done
+static void
+FsTestWrite(char *name, int id, int round)
 {
-	if ( !t->space->Load(t->getName()) ) {
-    	return;             // executable not found
+    int length = FsTestLength(id, round);
+    char *data = new char[length];
+    OpenFile *file;
+
+    for (int i = 0; i < length; i++)
+	data[i] = FsTestByte(id, round, i);
+    if (!kernel->fileSystem->Create(name, 0) ||
+		(file = kernel->fileSystem->Open(name)) == NULL) {
+	cout << "File system test: can't create " << name << "\n";
+	fsTestErrors++;
+    } else {
+	for (int i = 0; i < length; i += FsTestPiece) {
+	    file->Write(&data[i], min(FsTestPiece, length - i));
+	    kernel->currentThread->Yield();
+	}
+	delete file;
     }
-	
-    t->space->Execute(t->getName());
+    delete[] data;
+}
 
+// Check that "name" holds what thread "id" wrote in round "round": all
+// of it, or, unless "complete", any part of it from the start; or
+// nothing at all, if "mayBeMissing"
+static void
+FsTestCheck(char *name, int id, int round, bool complete, bool mayBeMissing)
+{
+    OpenFile *file = kernel->fileSystem->Open(name);
+    int length = FsTestLength(id, round);
+    int numRead;
+    char *data;
+
+    if (file == NULL) {
+	if (!mayBeMissing) {
+	    cout << "File system test: " << name << " is missing\n";
+	    fsTestErrors++;
+	}
+	return;
+    }
+    data = new char[length + 1];
+    numRead = file->Read(data, length + 1);
+    if (numRead > length || (complete && numRead != length)) {
+	cout << "File system test: " << name << " has " << numRead
+	     << " bytes, not " << length << "\n";
+	fsTestErrors++;
+    } else {
+	for (int i = 0; i < numRead; i++)
+	    if (data[i] != FsTestByte(id, round, i)) {
+		cout << "File system test: " << name << " is wrong at byte "
+		     << i << "\n";
+		fsTestErrors++;
+		break;
+	    }
+    }
+    delete[] data;
+    delete file;
+}
+
+// The body of each thread; "arg" points to its number
+static void
+FsTestThread(void *arg)
+{
+    int id = *(int *) arg;
+    int next = (id + 1) % FsTestThreads;
+    char name[40];
+    char *common;
+    OpenFile *file;
+
+    for (int round = 0; round < FsTestRounds; round++) {
+	sprintf(name, "/fstest/own%d/f%d", id, round);
+	FsTestWrite(name, id, round);
+
+	sprintf(name, "/fstest/shared/t%d.%d", id, round);
+	FsTestWrite(name, id, round);
+	if (round >= 2) {
+	    sprintf(name, "/fstest/shared/t%d.%d", id, round - 2);
+	    if (!kernel->fileSystem->Remove(name, FALSE)) {
+		cout << "File system test: can't remove " << name << "\n";
+		fsTestErrors++;
+	    }
+	}
+
+	sprintf(name, "/fstest/shared/t%d.%d", next, round);
+	for (int i = 0; i < FsTestPolls; i++) {
+	    FsTestCheck(name, next, round, FALSE, TRUE);
+	    kernel->currentThread->Yield();
+	}
+
+	common = new char[FsTestCommonLength];
+	file = kernel->fileSystem->Open("/fstest/common");
+	if (file == NULL ||
+		file->ReadAt(common, FsTestCommonLength, 0) != FsTestCommonLength) {
+	    cout << "File system test: can't read /fstest/common\n";
+	    fsTestErrors++;
+	} else {
+	    for (int i = 0; i < FsTestCommonLength; i++)
+		if (common[i] != FsTestByte(FsTestThreads, 0, i)) {
+		    cout << "File system test: /fstest/common is wrong at byte " << i << "\n";
+		    fsTestErrors++;
+		    break;
+		}
+	}
+	delete file;
+	delete[] common;
+
+	sprintf(name, "/fstest/own%d/d%d", id, round);
+	kernel->fileSystem->CreateDirectory(name);
+	sprintf(name, "/fstest/own%d/d%d/x", id, round);
+	FsTestWrite(name, id, round);
+	sprintf(name, "/fstest/own%d/d%d/x", next, round);
+	FsTestCheck(name, next, round, FALSE, TRUE);
+	sprintf(name, "/fstest/own%d/d%d", id, round);
+	if (!kernel->fileSystem->Remove(name, TRUE)) {
+	    cout << "File system test: can't remove " << name << "\n";
+	    fsTestErrors++;
+	}
+    }
+    fsTestDone->V();
+}
+
+void
+Kernel::FileSystemTest() {
+    int ids[FsTestThreads];
+    int numFree;
+    char name[40];
+    char *common = new char[FsTestCommonLength];
+    OpenFile *file;
+    Thread *t;
+
+    // directories never shrink, so make sure the root has room for
+    // the test's own first, or that would count as a leak
+    fileSystem->CreateDirectory("/fstest");
+    fileSystem->Remove("/fstest", TRUE);
+    numFree = fileSystem->NumFreeSectors();
+
+    fsTestDone = new Semaphore("file system test", 0);
+    fsTestErrors = 0;
+    fileSystem->CreateDirectory("/fstest");
+    fileSystem->CreateDirectory("/fstest/shared");
+    for (int id = 0; id < FsTestThreads; id++) {
+	sprintf(name, "/fstest/own%d", id);
+	fileSystem->CreateDirectory(name);
+    }
+    for (int i = 0; i < FsTestCommonLength; i++)
+	common[i] = FsTestByte(FsTestThreads, 0, i);
+    fileSystem->Create("/fstest/common", 0);
+    file = fileSystem->Open("/fstest/common");
+    file->Write(common, FsTestCommonLength);
+    delete file;
+    delete[] common;
+
+    for (int id = 0; id < FsTestThreads; id++) {
+	ids[id] = id;
+	t = new Thread("file system test", id + 1);
+	t->Fork((VoidFunctionPtr) FsTestThread, (void *) &ids[id]);
+    }
+    for (int id = 0; id < FsTestThreads; id++)
+	fsTestDone->P();
+
+    for (int id = 0; id < FsTestThreads; id++) {
+	for (int round = 0; round < FsTestRounds; round++) {
+	    sprintf(name, "/fstest/own%d/f%d", id, round);
+	    FsTestCheck(name, id, round, TRUE, FALSE);
+	    sprintf(name, "/fstest/own%d/d%d", id, round);
+	    FsTestCheck(name, id, round, FALSE, TRUE); // ie, it's gone
+	    sprintf(name, "/fstest/shared/t%d.%d", id, round);
+	    if (round >= FsTestRounds - 2)
+		FsTestCheck(name, id, round, TRUE, FALSE);
+	    else if ((file = fileSystem->Open(name)) != NULL) {
+		cout << "File system test: " << name << " wasn't removed\n";
+		fsTestErrors++;
+		delete file;
+	    }
+	}
+    }
+    fileSystem->Remove("/fstest", TRUE);
+    if (fileSystem->NumFreeSectors() != numFree) {
+	cout << "File system test: " << numFree - fileSystem->NumFreeSectors()
+	     << " sectors not freed\n";
+	fsTestErrors++;
+    }
+    delete fsTestDone;
+
+    if (fsTestErrors == 0)
+	cout << "File system test passed\n";
+    else
+	cout << "File system test FAILED: " << fsTestErrors << " errors\n";
+}
+#endif // FILESYS_STUB
+
+void ForkExecute(Thread *t)
+{
+    t->space->Execute(t->getName());
 }
 
 void Kernel::ExecAll()
@@ -294,14 +597,53 @@ void Kernel::ExecAll()
 }
 
 
+//----------------------------------------------------------------------
+// Kernel::Exec
+// 	Start the user program in file "name", from the command line: so
+//	nobody can Join it.  Return its SpaceId, or -1.
+//----------------------------------------------------------------------
+
 int Kernel::Exec(char* name)
 {
-	t[threadNum] = new Thread(name, threadNum);
-	t[threadNum]->space = new AddrSpace();
-	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
-	threadNum++;
+	return ExecV(1, &name, -1);
+}
 
-	return threadNum-1;
+//----------------------------------------------------------------------
+// Kernel::ExecV
+// 	Start the user program in file "argv[0]", with arguments "argv",
+//	in a thread of its own.  The program is set up (see
+//	AddrSpace::Load) before this returns, so that if it can't be run,
+//	the caller finds out.
+//
+//	The process table hands out the SpaceId, which is kept in the
+//	address space.  Thread IDs aren't unique (kernel threads such as
+//	the cache's read-ahead are all 1), so they are only labels: the
+//	thread gets the SpaceId as its ID, to tell it apart when
+//	debugging.
+//
+//	Return the program's SpaceId, or -1 if the file can't be loaded,
+//	the arguments don't fit on its stack, or too many programs are
+//	running.
+//
+//	"parent" -- the program that may Join it, -1 if none
+//----------------------------------------------------------------------
+
+int Kernel::ExecV(int argc, char **argv, int parent)
+{
+	AddrSpace *space = new AddrSpace();
+	Thread *t;
+	int id;
+
+	if (!space->Load(argv[0]) || !space->PushArguments(argc, argv)
+			|| (id = processTable->Add(parent)) == -1) {
+		delete space;
+		return -1;
+	}
+	space->SetId(id);
+	t = new Thread(argv[0], id);
+	t->space = space;
+	t->Fork((VoidFunctionPtr) &ForkExecute, (void *)t);
+	return id;
 /*
     cout << "Total threads number is " << execfileNum << endl;
     for (int n=1;n<=execfileNum;n++) {
@@ -24,6 +24,10 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class BufferCache;
+class InodeTable;
+class FrameTable;
+class ProcessTable;
 
 
 
@@ -41,12 +45,17 @@ class Kernel {
 	void PrepareToEnd(); // called before all running programs end
 	
 	void ExecAll();
-	int Exec(char* name);
+	int Exec(char* name);		// Start a user program ...
+	int ExecV(int argc, char **argv, int parent);
+					// ... with arguments; return its
+					// SpaceId, or -1 if it can't be run
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
     void NetworkTest();         // interactive 2-machine network test
-	Thread* getThread(int threadID){return t[threadID];}    
+#ifndef FILESYS_STUB
+    void FileSystemTest();      // multi-threaded file system stress test
+#endif
 
 	#ifdef FILESYS_STUB	
 	int CreateFile(char* filename); // fileSystem call
@@ -61,10 +70,14 @@ class Kernel {
     Statistics *stats;		// performance metrics
     Alarm *alarm;		// the software alarm clock    
     Machine *machine;           // the simulated CPU
+    FrameTable *frameTable;	// what each page of its memory holds
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    BufferCache *bufferCache;	// sectors cached for the file system
+    InodeTable *inodeTable;	// headers of the files in use
     FileSystem *fileSystem;     
+    ProcessTable *processTable;	// user programs running
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
 
@@ -72,17 +85,23 @@ class Kernel {
 
   private:
 
-	Thread* t[10];
 	char*   execfile[10];
 	int execfileNum;
-	int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
     bool debugUserProg;         // single step user program
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
+    int diskCacheSegments;      // tracks in the disk's cache; 0 for
+                                // just a track buffer
+    bool diskWriteBack;         // disk cache is write-back
+    int cacheBuffers;           // size of the buffer cache, in sectors
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    int diskTracks;           // geometry for a newly formatted disk
+    int diskSectorsPerTrack;
+    int diskCrashWrites;      // crash during this write request, to
+                              // test recovery; 0 for never
 #endif
 };
 
@@ -4,10 +4,12 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
+//              -dc <# cache tracks> -dw -bc <# cache sectors>
+//              -f -dg <# tracks> <# sectors per track>
+//              -cp <unix file> <nachos file>
 //              -p <nachos file> -r <nachos file> -l -D
 //              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -z -K -C -N -F
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
@@ -16,6 +18,10 @@
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
+//    -dc gives the disk a cache of the given number of tracks
+//    -dw makes the disk's cache write-back (with -dc)
+//    -bc sets the number of sectors in the file system's buffer cache
+//        (at least MinCacheBuffers)
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
 //    -K run a simple self test of kernel threads and synchronization
@@ -24,11 +30,17 @@
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -dg sets the number of tracks and sectors per track of a newly
+//        formatted disk (so it needs -f)
+//    -crash makes the disk crash part way through the given write
+//        request, to test recovery (see Disk::SetCrash)
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system
+//    -F runs a stress test of the file system, with several threads
+//        using it at once (see Kernel::FileSystemTest; try it with -rs)
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -69,6 +81,10 @@ Cleanup(int x)
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+// Copy moves data in bigger pieces, so that each Write covers a run of
+// sectors that can go to the disk as a single multi-sector request.
+static const int CopyTransferSize = 32 * TransferSize;
+
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
@@ -79,7 +95,7 @@ static void Copy(char *from, char *to)
 {
     int fd;
     OpenFile *openFile;
-    int amountRead, fileLength;
+    int amountRead;
     char *buffer;
 
     // Open UNIX file
@@ -89,14 +105,9 @@ static void Copy(char *from, char *to)
         return;
     }
 
-    // Figure out length of UNIX file
-    Lseek(fd, 0, 2);
-    fileLength = Tell(fd);
-    Lseek(fd, 0, 0);
-
-    // Create a Nachos file of the same length
-    DEBUG('f', "Copying file " << from << " of size " << fileLength << " to file " << to);
-    if (!kernel->fileSystem->Create(to, fileLength))
+    // Create an empty Nachos file; it grows as we write to it
+    DEBUG('f', "Copying file " << from << " to file " << to);
+    if (!kernel->fileSystem->Create(to, 0))
     { // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
@@ -106,9 +117,9 @@ static void Copy(char *from, char *to)
     openFile = kernel->fileSystem->Open(to);
     ASSERT(openFile != NULL);
 
-    // Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * TransferSize)) > 0)
+    // Copy the data in CopyTransferSize chunks
+    buffer = new char[CopyTransferSize];
+    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * CopyTransferSize)) > 0)
         openFile->Write(buffer, amountRead);
     delete[] buffer;
 
@@ -192,6 +203,7 @@ int main(int argc, char **argv)
     bool mkdirFlag = false;
     bool recursiveListFlag = false;
     bool recursiveRemoveFlag = false;
+    bool fsTestFlag = false;
 #endif //FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -285,6 +297,10 @@ int main(int argc, char **argv)
         {
             dumpFlag = true;
         }
+        else if (strcmp(argv[i], "-F") == 0)
+        {
+            fsTestFlag = true;
+        }
 #endif //FILESYS_STUB
         else if (strcmp(argv[i], "-u") == 0)
         {
@@ -294,7 +310,7 @@ int main(int argc, char **argv)
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
-            cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-l] [-D] [-F]\n";
 #endif //FILESYS_STUB
         }
     }
@@ -349,6 +365,11 @@ int main(int argc, char **argv)
     {
         Print(printFileName);
     }
+    if (fsTestFlag)
+    {
+        kernel->FileSystemTest();
+    }
+    kernel->fileSystem->Sync(); // make the changes above stick
 #endif // FILESYS_STUB
 
     // finally, run an initial user program if requested to do so
@@ -295,3 +295,108 @@ void Condition::Broadcast(Lock* conditionLock)
         Signal(conditionLock);
     }
 }
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, so that it can be used for
+//	synchronization.  Initially, no one holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    lock = new Lock("reader-writer lock");
+    released = new Condition("reader-writer lock");
+    readers = 0;
+    writer = NULL;
+    writeDepth = 0;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	Deallocate a reader-writer lock.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == NULL);
+    delete released;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+//	Wait until no other thread is writing, then hold the lock for
+//	reading.  The writer itself may read; that counts as one more
+//	hold of its write.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireRead()
+{
+    lock->Acquire();
+    if (writer == kernel->currentThread) {
+	writeDepth++;
+    } else {
+	while (writer != NULL)
+	    released->Wait(lock);
+	readers++;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+//	Give up a hold made by AcquireRead; if it was the last, let a
+//	writer in.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    if (writer == kernel->currentThread) {
+	ASSERT(writeDepth > 1);
+	writeDepth--;
+    } else {
+	ASSERT(readers > 0);
+	if (--readers == 0)
+	    released->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+//	Wait until no other thread holds the lock at all, then hold it
+//	for writing.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    if (writer != kernel->currentThread) {
+	while (writer != NULL || readers > 0)
+	    released->Wait(lock);
+	writer = kernel->currentThread;
+    }
+    writeDepth++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+//	Give up a hold made by AcquireWrite; if it was the last, let the
+//	threads waiting for the lock in.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(writer == kernel->currentThread && writeDepth > 0);
+    if (--writeDepth == 0) {
+	writer = NULL;
+	released->Broadcast(lock);
+    }
+    lock->Release();
+}
@@ -1,11 +1,12 @@
 // synch.h 
 //	Data structures for synchronizing threads.
 //
-//	Three kinds of synchronization are defined here: semaphores,
-//	locks, and condition variables.  The implementation for
-//	semaphores is given; for the latter two, only the procedure
-//	interface is given -- they are to be implemented as part of 
-//	the first assignment.
+//	Four kinds of synchronization are defined here: semaphores,
+//	locks, condition variables, and reader-writer locks.  The
+//	implementation for semaphores is given; for locks and condition
+//	variables, only the procedure interface is given -- they are to
+//	be implemented as part of the first assignment.  Reader-writer
+//	locks are built out of a lock and a condition variable.
 //
 //	Note that all the synchronization objects take a "name" as
 //	part of the initialization.  This is solely for debugging purposes.
@@ -141,4 +142,50 @@ class Condition {
     char* name;
     List<Semaphore *> *waitQueue;	// list of waiting threads
 };
+
+// The following class defines a "reader-writer lock".  Any number of
+// threads may hold it for reading at once, but a thread holding it for
+// writing holds it alone:
+//
+//	AcquireRead -- wait until no other thread holds the lock for
+//		writing, then hold it for reading
+//
+//	AcquireWrite -- wait until no other thread holds the lock at
+//		all, then hold it for writing
+//
+//	ReleaseRead, ReleaseWrite -- give up what was acquired, waking
+//		up threads waiting for the lock if it is now free
+//
+// A thread may acquire the lock again while it holds it, for reading
+// or, if it already holds it for writing, for writing; each Acquire
+// needs its own Release.  (A thread that holds the lock only for
+// reading must not ask to write: it would wait for itself.)
+//
+// Readers are let in whenever no one is writing, even if a writer is
+// waiting.  Writers can be held off for as long as readers keep
+// overlapping, but a thread that already reads never waits behind a
+// writer, which is what lets it acquire the lock again.
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize lock to be free
+    ~RWLock();				// deallocate lock
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireRead();			// share the lock with other readers
+    void ReleaseRead();
+    void AcquireWrite();		// hold the lock alone
+    void ReleaseWrite();
+
+  private:
+    char *name;				// debugging assist
+    Lock *lock;				// protects the fields below
+    Condition *released;		// signalled when the lock may
+					// have become free
+    int readers;			// number of read holds
+    Thread *writer;			// thread holding it for writing,
+					// NULL if none
+    int writeDepth;			// number of holds (read or write)
+					// the writer has
+};
 #endif // SYNCH_H
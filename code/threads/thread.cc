@@ -30,13 +30,15 @@ const int STACK_FENCEPOST = 0xdedbeef;
 // 	Initialize a thread control block, so that we can then call
 //	Thread::Fork.
 //
-//	"threadName" is an arbitrary string, useful for debugging.
+//	"threadName" is an arbitrary string, useful for debugging; the
+//	thread keeps a copy of it, so it needn't outlive the thread.
 //----------------------------------------------------------------------
 
 Thread::Thread(char* threadName, int threadID)
 {
 	ID = threadID;
-    name = threadName;
+    name = new char[strlen(threadName) + 1];
+    strcpy(name, threadName);
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
@@ -66,6 +68,7 @@ Thread::~Thread()
     ASSERT(this != kernel->currentThread);
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    delete [] name;
 }
 
 //----------------------------------------------------------------------
@@ -18,8 +18,10 @@
 #include "copyright.h"
 #include "main.h"
 #include "addrspace.h"
+#include "frametable.h"
 #include "machine.h"
 #include "noff.h"
+#include "syscall.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -57,47 +59,86 @@ SwapHeader (NoffHeader *noffH)
 #endif
 }
 
+//----------------------------------------------------------------------
+// WithinSegment
+// 	Return whether page "vpn" lies entirely within "segment".
+//----------------------------------------------------------------------
+
+static bool
+WithinSegment(Segment *segment, int vpn)
+{
+    return segment->size > 0 && segment->virtualAddr <= vpn * PageSize
+	&& (vpn + 1) * PageSize <= segment->virtualAddr + segment->size;
+}
+
+//----------------------------------------------------------------------
+// MappedFileCompare
+// 	Order mapped files by where they are in the address space.
+//----------------------------------------------------------------------
+
+static int
+MappedFileCompare(MappedFile *x, MappedFile *y)
+{
+    return x->firstPage - y->firstPage;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
-// 	Create an address space to run a user program.
-//	Set up the translation from program memory to physical 
-//	memory.  For now, this is really simple (1:1), since we are
-//	only uniprogramming, and we have a single unsegmented page table
+// 	Create an address space to run a user program.  It is empty
+//	until the program is loaded into it.
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace()
 {
-    pageTable = new TranslationEntry[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
-	pageTable[i].physicalPage = i;
-	pageTable[i].valid = TRUE;
-	pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  
-    }
-    
-    // zero out the entire address space
-    bzero(kernel->machine->mainMemory, MemorySize);
+    spaceId = -1;
+    pageTable = NULL;
+    numPages = imagePages = 0;
+    reservedPages = 0;
+    executable = NULL;
+    mappedFiles = new SortedList<MappedFile *>(MappedFileCompare);
+
+    for (int i = 0; i < MaxOpenFiles; i++)
+	openFiles[i] = -1;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space, writing back any files the program
+//	left mapped, closing any it left open, and freeing its memory.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   kernel->frameTable->Acquire();
+   while (!mappedFiles->IsEmpty())
+	Unmap(mappedFiles->RemoveFront());
+   delete mappedFiles;
+   for (unsigned int i = 0; i < numPages; i++)
+	if (pageTable[i].valid)
+	    FreePage(i);
+   kernel->frameTable->Release();
+   for (int i = 0; i < MaxOpenFiles; i++)
+	if (openFiles[i] != -1)
+	    kernel->fileSystem->CloseFile(openFiles[i]);
+   kernel->frameTable->Unreserve(reservedPages);
+   delete [] pageTable;
+   delete executable;
 }
 
-
 //----------------------------------------------------------------------
 // AddrSpace::Load
-// 	Load a user program into memory from a file.
+// 	Set up the address space to run a user program from a file.
+//	Nothing is read in yet but the file's header: each page is read
+//	in by the page fault the first time the program touches it (see
+//	LoadPage), so the file stays open.
+//
+//	Frames are reserved for every page the program may change (see
+//	FrameTable::Reserve): only pages of nothing but code or read-only
+//	data are left out.
 //
-//	Assumes that the page table has been initialized, and that
-//	the object code file is in NOFF format.
+//	Assumes that the object code file is in NOFF format.  Return
+//	FALSE if it can't be opened, or is too big, or there isn't enough
+//	memory to reserve.
 //
 //	"fileName" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
@@ -105,10 +146,10 @@ AddrSpace::~AddrSpace()
 bool 
 AddrSpace::Load(char *fileName) 
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
-    NoffHeader noffH;
     unsigned int size;
+    int writable = 0;
 
+    executable = kernel->fileSystem->Open(fileName);
     if (executable == NULL) {
 	cerr << "Unable to open file " << fileName << "\n";
 	return FALSE;
@@ -132,47 +173,93 @@ AddrSpace::Load(char *fileName)
 			+ UserStackSize;	// we need to increase the size
 						// to leave room for the stack
 #endif
-    numPages = divRoundUp(size, PageSize);
+    if (divRoundUp(size, PageSize) > MaxVirtualPages) {
+	cerr << "Not enough memory to run " << fileName << "\n";
+	return FALSE;
+    }
+    numPages = imagePages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
-
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
-						// to run anything too big --
-						// at least until we have
-						// virtual memory
+    numArgs = argvAddr = 0;		// until PushArguments
+    stackStart = size - 16;
 
     DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
+    DEBUG(dbgAddr, "Code segment: " << noffH.code.virtualAddr << ", " << noffH.code.size);
+    DEBUG(dbgAddr, "Data segment: " << noffH.initData.virtualAddr << ", " << noffH.initData.size);
+#ifdef RDATA
+    DEBUG(dbgAddr, "Read only data segment: " << noffH.readonlyData.virtualAddr << ", " << noffH.readonlyData.size);
+#endif
 
-// then, copy in the code and data segments into memory
-// Note: this code assumes that virtual address = physical address
-    if (noffH.code.size > 0) {
-        DEBUG(dbgAddr, "Initializing code segment.");
-	DEBUG(dbgAddr, noffH.code.virtualAddr << ", " << noffH.code.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.code.virtualAddr]), 
-			noffH.code.size, noffH.code.inFileAddr);
-    }
-    if (noffH.initData.size > 0) {
-        DEBUG(dbgAddr, "Initializing data segment.");
-	DEBUG(dbgAddr, noffH.initData.virtualAddr << ", " << noffH.initData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
+// every page starts out invalid, to be read in on demand
+    pageTable = new TranslationEntry[numPages];
+    for (unsigned int i = 0; i < numPages; i++) {
+	pageTable[i].virtualPage = i;
+	pageTable[i].valid = FALSE;
+	pageTable[i].readOnly = FALSE;
     }
 
+// frames for the pages it may change, which can't be evicted
+    for (unsigned int i = 0; i < numPages; i++)
+	if (!WithinSegment(&noffH.code, i)
 #ifdef RDATA
-    if (noffH.readonlyData.size > 0) {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-	DEBUG(dbgAddr, noffH.readonlyData.virtualAddr << ", " << noffH.readonlyData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.readonlyData.virtualAddr]),
-			noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
-    }
+		&& !WithinSegment(&noffH.readonlyData, i)
 #endif
+	   )
+	    writable++;
+    if (!kernel->frameTable->Reserve(writable)) {
+	cerr << "Not enough memory to run " << fileName << "\n";
+	return FALSE;
+    }
+    reservedPages = writable;
 
-    delete executable;			// close file
     return TRUE;			// success
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::PushArguments
+// 	Copy a program's arguments onto the top of its stack, where main
+//	will find them as "argc" and "argv": first the strings, then (word
+//	aligned) the array of pointers to them, ending with a NULL.  The
+//	stack starts below that, leaving room for main to save its
+//	argument registers, as the MIPS calling convention says.
+//
+//	Return FALSE if they would take up more than half the stack.
+//
+//	"argc" -- the number of arguments
+//	"argv" -- the arguments, the first being the program's name
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PushArguments(int argc, char **argv)
+{
+    int sp = imagePages * PageSize;
+    int length, total = (argc + 1) * 4;
+    int *addrs = new int[argc + 1];
+
+    for (int i = 0; i < argc; i++)
+	total += strlen(argv[i]) + 1;
+    if (total + 3 > UserStackSize / 2) {
+	delete [] addrs;
+	return FALSE;
+    }
+
+    for (int i = argc - 1; i >= 0; i--) {
+	length = strlen(argv[i]) + 1;
+	sp -= length;
+	CopyOut(argv[i], sp, length);
+	addrs[i] = WordToHost(sp);
+    }
+    addrs[argc] = 0;
+    sp -= sp % 4;
+    sp -= (argc + 1) * 4;
+    CopyOut((char *) addrs, sp, (argc + 1) * 4);
+    delete [] addrs;
+
+    numArgs = argc;
+    argvAddr = sp;
+    stackStart = sp - 16;
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::Execute
 // 	Run a user program using the current thread
@@ -228,11 +315,15 @@ AddrSpace::InitRegisters()
     // after start will be at virtual address four.
     machine->WriteRegister(NextPCReg, 4);
 
+    // main's arguments, if any
+    machine->WriteRegister(4, numArgs);
+    machine->WriteRegister(5, argvAddr);
+
    // Set the stack register to the end of the address space, where we
-   // allocated the stack; but subtract off a bit, to make sure we don't
-   // accidentally reference off the end!
-    machine->WriteRegister(StackReg, numPages * PageSize - 16);
-    DEBUG(dbgAddr, "Initializing stack pointer: " << numPages * PageSize - 16);
+   // allocated the stack (below any arguments); but subtract off a bit,
+   // to make sure we don't accidentally reference off the end!
+    machine->WriteRegister(StackReg, stackStart);
+    DEBUG(dbgAddr, "Initializing stack pointer: " << stackStart);
 }
 
 //----------------------------------------------------------------------
@@ -283,6 +374,10 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
 
     pte = &pageTable[vpn];
 
+    if(!pte->valid) {
+        return PageFaultException;
+    }
+
     if(isReadWrite && pte->readOnly) {
         return ReadOnlyException;
     }
@@ -311,6 +406,517 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::UserRun
+// 	Find where the program's memory at "vaddr" is in physical memory,
+//	so that the kernel can copy to or from it in bulk.  Return a
+//	pointer to it, and in "*length", how many of the "size" bytes
+//	starting there are contiguous in physical memory: the rest of the
+//	page, and as many of the pages after it as happen to follow it.
+//	Each page is translated just once.
+//
+//	If "vaddr" is in a page that isn't in memory, it is read in first.
+//	Return NULL if "vaddr" is not a valid address, or (if "writing")
+//	is on a read-only page, or memory is full; a transfer that runs
+//	into such a page ends there.
+//
+//	The run's frames are pinned, so that they stay put until the
+//	caller is done with them and calls ReleaseRun.
+//
+//	"vaddr" -- the virtual address
+//	"size" -- the number of bytes wanted from there on
+//	"writing" -- TRUE if the kernel is going to change them
+//	"length" -- set to the number of bytes that can be
+//		transferred at once
+//----------------------------------------------------------------------
+
+char *
+AddrSpace::UserRun(int vaddr, int size, bool writing, int *length)
+{
+    unsigned int paddr, nextPaddr;
+    ExceptionType exception;
+    int n;
+
+    ASSERT(size > 0);
+    if (vaddr < 0)
+	return NULL;
+    kernel->frameTable->Acquire();
+    exception = Translate(vaddr, &paddr, writing);
+    if (exception == PageFaultException && ReadIn(vaddr))
+	exception = Translate(vaddr, &paddr, writing);
+    if (exception != NoException) {
+	kernel->frameTable->Release();
+	return NULL;
+    }
+    n = min(size, PageSize - vaddr % PageSize);
+    while (n < size && Translate(vaddr + n, &nextPaddr, writing) == NoException
+		&& nextPaddr == paddr + n)
+	n += min(size - n, PageSize);
+    for (unsigned int frame = paddr / PageSize;
+		frame <= (paddr + n - 1) / PageSize; frame++)
+	kernel->frameTable->Pin(frame);
+    kernel->frameTable->Release();
+    *length = n;
+    return &kernel->machine->mainMemory[paddr];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReleaseRun
+// 	Unpin the frames of "run", "length" bytes long, which UserRun
+//	returned, once the kernel is done copying to or from it.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReleaseRun(char *run, int length)
+{
+    int paddr = run - kernel->machine->mainMemory;
+
+    for (int frame = paddr / PageSize; frame <= (paddr + length - 1) / PageSize;
+		frame++)
+	kernel->frameTable->Unpin(frame);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocatePage
+// 	Give virtual page "vpn" a frame of physical memory, zeroed,
+//	evicting some other page if need be.  Return FALSE if memory is
+//	full of pages that can't be evicted.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::AllocatePage(int vpn)
+{
+    int frame = kernel->frameTable->Allocate(this, vpn);
+
+    if (frame == -1)
+	return FALSE;
+    bzero(&kernel->machine->mainMemory[frame * PageSize], PageSize);
+    pageTable[vpn].physicalPage = frame;
+    pageTable[vpn].valid = TRUE;
+    pageTable[vpn].use = FALSE;
+    pageTable[vpn].dirty = FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FreePage
+// 	Give back the frame of virtual page "vpn".  The caller holds the
+//	frame table's lock.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FreePage(int vpn)
+{
+    ASSERT(pageTable[vpn].valid);
+    kernel->frameTable->Free(pageTable[vpn].physicalPage);
+    pageTable[vpn].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Mmap
+// 	Map the first "length" bytes of the file open as descriptor "id"
+//	into the address space, after the program and any files already
+//	mapped, in the first gap big enough.  If the file is shorter, the
+//	rest reads as zeros; if the program changes that part, the file
+//	grows to hold it.
+//
+//	No page is read in yet: each is read in by the page fault the
+//	first time the program touches it (see PageIn).  The mapping
+//	holds the file open, even once "id" is closed.
+//
+//	Return the virtual address the file starts at, or -1 if "id"
+//	isn't open, or the address space would get too big.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Mmap(OpenFileId id, int length)
+{
+    int entry = DescriptorEntry(id);
+    int pages, first = imagePages;
+    TranslationEntry *larger;
+    MappedFile *mapped;
+
+    if (entry == -1 || length <= 0 || length > MaxVirtualPages * PageSize)
+	return -1;
+    pages = divRoundUp(length, PageSize);
+
+    ListIterator<MappedFile *> iter(mappedFiles);
+    for (; !iter.IsDone(); iter.Next()) {
+	if (first + pages <= iter.Item()->firstPage)
+	    break;
+	first = iter.Item()->firstPage + iter.Item()->numPages;
+    }
+    if (first + pages > MaxVirtualPages)
+	return -1;
+
+    kernel->frameTable->Acquire();	// no evicting while the table moves
+    if ((unsigned int) (first + pages) > numPages) {
+	larger = new TranslationEntry[first + pages];
+	for (int i = 0; i < first + pages; i++) {
+	    if ((unsigned int) i < numPages) {
+		larger[i] = pageTable[i];
+		continue;
+	    }
+	    larger[i].virtualPage = i;
+	    larger[i].valid = FALSE;
+	    larger[i].readOnly = FALSE;
+	}
+	delete [] pageTable;
+	pageTable = larger;
+	numPages = first + pages;
+	if (kernel->currentThread->space == this)
+	    RestoreState();		// the machine has the old table
+    }
+    kernel->frameTable->Release();
+
+    kernel->fileSystem->ShareFile(entry);
+    mapped = new MappedFile;
+    mapped->firstPage = first;
+    mapped->numPages = pages;
+    mapped->length = length;
+    mapped->entry = entry;
+    mappedFiles->Insert(mapped);
+    DEBUG(dbgAddr, "Mapped " << length << " bytes of file " << id << " at page " << first);
+    return first * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Munmap
+// 	Unmap the file mapped at "vaddr".  Return FALSE if none is.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Munmap(int vaddr)
+{
+    ListIterator<MappedFile *> iter(mappedFiles);
+
+    kernel->frameTable->Acquire();	// its pages may be being evicted
+    for (; !iter.IsDone(); iter.Next())
+	if (iter.Item()->firstPage * PageSize == vaddr) {
+	    MappedFile *mapped = iter.Item();
+
+	    mappedFiles->Remove(mapped);
+	    Unmap(mapped);
+	    kernel->frameTable->Release();
+	    return TRUE;
+	}
+    kernel->frameTable->Release();
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindMapped
+// 	Return the mapped file that page "vpn" is part of, or NULL if
+//	none.
+//----------------------------------------------------------------------
+
+MappedFile *
+AddrSpace::FindMapped(int vpn)
+{
+    ListIterator<MappedFile *> iter(mappedFiles);
+
+    for (; !iter.IsDone(); iter.Next())
+	if (vpn >= iter.Item()->firstPage
+		&& vpn < iter.Item()->firstPage + iter.Item()->numPages)
+	    return iter.Item();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WriteBack
+// 	Write page "vpn" of "mapped" back to the file, with a positional
+//	write: as much of it as the mapping covers.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::WriteBack(MappedFile *mapped, int vpn)
+{
+    int offset = (vpn - mapped->firstPage) * PageSize;
+    int size = min(PageSize, mapped->length - offset);
+    char *frame = &kernel->machine->mainMemory[pageTable[vpn].physicalPage * PageSize];
+
+    DEBUG(dbgAddr, "Writing back page " << vpn << " of a mapped file");
+    kernel->fileSystem->WriteFileVAt(&frame, &size, 1, offset, mapped->entry);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unmap
+// 	Write back each page of "mapped" that the program has changed,
+//	free its pages, and let go of the file.  The caller holds the
+//	frame table's lock.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Unmap(MappedFile *mapped)
+{
+    for (int vpn = mapped->firstPage; vpn < mapped->firstPage + mapped->numPages; vpn++) {
+	if (!pageTable[vpn].valid)
+	    continue;
+	if (pageTable[vpn].dirty)
+	    WriteBack(mapped, vpn);
+	FreePage(vpn);
+    }
+    kernel->fileSystem->CloseFile(mapped->entry);
+    delete mapped;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Give page "vpn" of the program a frame, and read in whatever parts
+//	of the code and data segments it holds (usually one; but a page
+//	may hold the end of one segment and the start of the next).  The
+//	rest of it -- uninitialized data or stack -- stays zero.
+//	Return FALSE if memory is full.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::LoadPage(int vpn)
+{
+    Segment *segments[] = { &noffH.code, &noffH.initData,
+#ifdef RDATA
+			    &noffH.readonlyData,
+#endif
+			  };
+    int start = vpn * PageSize, from, to;
+    char *frame;
+
+    if (!AllocatePage(vpn))
+	return FALSE;
+    kernel->stats->numPageFaults++;
+    frame = &kernel->machine->mainMemory[pageTable[vpn].physicalPage * PageSize];
+    DEBUG(dbgAddr, "Reading in page " << vpn << " of the program");
+    for (unsigned int i = 0; i < sizeof(segments) / sizeof(Segment *); i++) {
+	from = max(start, segments[i]->virtualAddr);
+	to = min(start + PageSize, segments[i]->virtualAddr + segments[i]->size);
+	if (from < to)
+	    executable->ReadAt(&frame[from - start], to - from,
+			segments[i]->inFileAddr + from - segments[i]->virtualAddr);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Handle a page fault at "vaddr", by reading its page in: from the
+//	program's file (see LoadPage), or from a mapped file (through the
+//	buffer cache, which finds it on disk with the file header's
+//	ByteToSector).  Return FALSE if "vaddr" isn't in the address
+//	space, or memory is full.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(int vaddr)
+{
+    bool success;
+
+    kernel->frameTable->Acquire();
+    success = ReadIn(vaddr);
+    kernel->frameTable->Release();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadIn
+// 	Do the work of PageIn, with the frame table's lock held.  The page
+//	may have been read in already, by another thread's fault on it
+//	while this one waited for the lock.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::ReadIn(int vaddr)
+{
+    unsigned int vpn = (unsigned int) vaddr / PageSize;
+    int offset, size;
+    char *frame;
+    MappedFile *mapped;
+
+    if (vpn < imagePages)
+	return pageTable[vpn].valid || LoadPage(vpn);
+
+    mapped = FindMapped(vpn);
+    if (mapped == NULL)
+	return FALSE;
+    if (pageTable[vpn].valid)
+	return TRUE;
+    if (!AllocatePage(vpn))
+	return FALSE;
+    kernel->stats->numPageFaults++;
+    offset = (vpn - mapped->firstPage) * PageSize;
+    size = min(PageSize, mapped->length - offset);
+    frame = &kernel->machine->mainMemory[pageTable[vpn].physicalPage * PageSize];
+    DEBUG(dbgAddr, "Reading in page " << vpn << " of a mapped file");
+    kernel->fileSystem->ReadFileVAt(&frame, &size, 1, offset, mapped->entry);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Referenced
+// 	Return whether page "vpn" has been used since the last call (or
+//	since it was read in), and start over.  Used by the frame table's
+//	clock, to give recently used pages a second chance.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Referenced(int vpn)
+{
+    bool used = pageTable[vpn].use;
+
+    pageTable[vpn].use = FALSE;
+    return used;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+// 	Evict page "vpn", so that its frame can be used for another.  The
+//	page is marked invalid first, so that the program faults on it
+//	from now on.  A page of a mapped file is written back if the
+//	program changed it; a page of the program can be read in again
+//	from the executable (or zero-filled) as long as it hasn't changed.
+//	Return FALSE, leaving it be, if it has: there is nowhere else to
+//	keep it.
+//
+//	Called by the frame table, with its lock held.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageOut(int vpn)
+{
+    ASSERT(pageTable[vpn].valid);
+    if ((unsigned int) vpn < imagePages && pageTable[vpn].dirty)
+	return FALSE;
+    pageTable[vpn].valid = FALSE;
+    DEBUG(dbgAddr, "Evicting page " << vpn);
+    if ((unsigned int) vpn >= imagePages && pageTable[vpn].dirty)
+	WriteBack(FindMapped(vpn), vpn);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyIn
+// 	Copy "size" bytes at "vaddr" in the program's memory into "into".
+//	Return how many were copied: fewer than "size" if the buffer runs
+//	into an invalid address.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::CopyIn(int vaddr, char *into, int size)
+{
+    int done = 0, length;
+    char *run;
+
+    while (done < size) {
+	run = UserRun(vaddr + done, size - done, FALSE, &length);
+	if (run == NULL)
+	    break;
+	bcopy(run, &into[done], length);
+	ReleaseRun(run, length);
+	done += length;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOut
+// 	Copy "size" bytes from "from" out to "vaddr" in the program's
+//	memory.  Return how many were copied: fewer than "size" if the
+//	buffer runs into an invalid or read-only address.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::CopyOut(char *from, int vaddr, int size)
+{
+    int done = 0, length;
+    char *run;
+
+    while (done < size) {
+	run = UserRun(vaddr + done, size - done, TRUE, &length);
+	if (run == NULL)
+	    break;
+	bcopy(&from[done], run, length);
+	ReleaseRun(run, length);
+	done += length;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyInString
+// 	Copy the null-terminated string at "vaddr" in the program's memory
+//	into "into", which has room for "size" bytes.  Return FALSE if the
+//	string runs into an invalid address, or doesn't fit.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyInString(int vaddr, char *into, int size)
+{
+    int done = 0, length;
+    char *run, *end;
+
+    while (done < size) {
+	run = UserRun(vaddr + done, size - done, FALSE, &length);
+	if (run == NULL)
+	    return FALSE;
+	end = (char *) memchr(run, '\0', length);
+	if (end != NULL) {
+	    bcopy(run, &into[done], end - run + 1);
+	    ReleaseRun(run, length);
+	    return TRUE;
+	}
+	bcopy(run, &into[done], length);
+	ReleaseRun(run, length);
+	done += length;
+    }
+    return FALSE;
+}
+
+
+//----------------------------------------------------------------------
+// AddrSpace::AddDescriptor
+// 	Give the program a file descriptor for an entry in the system-wide
+//	open file table.  Return the lowest one free, or -1 if the program
+//	already has as many files open as it can.
+//
+//	"entry" -- the entry it is to refer to
+//----------------------------------------------------------------------
+
+OpenFileId
+AddrSpace::AddDescriptor(int entry)
+{
+    for (int i = SysConsoleOutput + 1; i < MaxOpenFiles; i++)
+	if (openFiles[i] == -1) {
+	    openFiles[i] = entry;
+	    return i;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DescriptorEntry
+// 	Return the open file table entry that descriptor "id" refers to,
+//	or -1 if "id" is not in use.  "id" comes from the user program, so
+//	it may be anything at all.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::DescriptorEntry(OpenFileId id)
+{
+    if (id < 0 || id >= MaxOpenFiles)
+	return -1;
+    return openFiles[id];
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::RemoveDescriptor
+// 	Free descriptor "id", and return the open file table entry it
+//	referred to (-1 if it was not in use).  The caller closes that.
+//----------------------------------------------------------------------
 
+int
+AddrSpace::RemoveDescriptor(OpenFileId id)
+{
+    int entry = DescriptorEntry(id);
 
+    if (entry != -1)
+	openFiles[id] = -1;
+    return entry;
+}
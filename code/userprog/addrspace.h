@@ -2,7 +2,26 @@
 //	Data structures to keep track of executing user programs 
 //	(address spaces).
 //
-//	For now, we don't keep any information about address spaces.
+//	An address space is a page table.  Its first pages hold the
+//	program itself -- code, data and stack -- and after them come
+//	any files the program has mapped into memory (see Mmap).  Each
+//	page is kept in a page of physical memory ("frame") of its own,
+//	allocated from kernel->frameTable.
+//
+//	Pages are "demand paged": they all start out invalid, and get a
+//	frame the first time the program touches one, when the page fault
+//	reads it in.  A page of the program is read from its segments in
+//	the executable file, which stays open while the program runs (or
+//	is zero-filled, for uninitialized data and the stack), so only the
+//	pages it actually uses cost it anything.  A page of a mapped file
+//	is read from that file; if the program changes it, it is written
+//	back when the file is unmapped, or the program exits.
+//
+//	When memory is full, a page may be evicted to make room for
+//	another (see frametable.h), and is read in again by the next page
+//	fault on it.  A frame the kernel is copying to or from is pinned:
+//	each run UserRun returns must be given back with ReleaseRun.
+//
 //	The user level CPU state is saved and restored in the thread
 //	executing the user program (see thread.h).
 //
@@ -15,8 +34,29 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "list.h"
+#include "noff.h"
+#include "syscall.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxOpenFiles		16	// file descriptors a program can
+					// have in use, including the
+					// console's (0 and 1)
+#define MaxStringLength		255	// longest string (eg, a path name)
+					// a system call takes
+#define MaxArgs			16	// most arguments ExecV takes
+#define MaxVirtualPages		4096	// largest an address space may
+					// grow, with the files mapped into it
+
+// The following class defines a file mapped into an address space.
+
+class MappedFile {
+  public:
+    int firstPage;			// First virtual page it is mapped at
+    int numPages;			// Number of pages it is mapped to
+    int length;				// Number of bytes of the file mapped
+    int entry;				// Its entry in the open file table
+};
 
 class AddrSpace {
   public:
@@ -27,6 +67,10 @@ class AddrSpace {
                                         // a file
 					// return false if not found
 
+    bool PushArguments(int argc, char **argv);	// Put "argv" on the
+					// stack, for main(argc, argv);
+					// FALSE if it doesn't fit
+
     void Execute(char *fileName);             	// Run a program
 					// assumes the program has already
                                         // been loaded
@@ -39,14 +83,93 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    // Get at the program's memory from the kernel, a page (or a run of
+    // pages that are consecutive in physical memory) at a time, instead
+    // of a byte at a time with ReadMem/WriteMem.
+    char *UserRun(int vaddr, int size, bool writing, int *length);
+					// Where "vaddr" is in physical
+					// memory, and how many of "size"
+					// bytes from there are contiguous;
+					// NULL if it isn't valid
+    void ReleaseRun(char *run, int length);	// Done with a run from
+					// UserRun
+    int CopyIn(int vaddr, char *into, int size);
+					// Copy "size" bytes in from the
+					// program; return how many were
+					// valid
+    int CopyOut(char *from, int vaddr, int size);
+					// Copy "size" bytes out to it
+    bool CopyInString(int vaddr, char *into, int size);
+					// Copy a null-terminated string in;
+					// FALSE if it is invalid, or needs
+					// more than "size" bytes
+
+    int Mmap(OpenFileId id, int length);	// Map "length" bytes of a file
+					// into memory; return the address
+					// they start at, or -1
+    bool Munmap(int vaddr);		// Undo Mmap, writing back any
+					// changed pages of the file
+    bool PageIn(int vaddr);		// Read the page holding "vaddr" in,
+					// on a page fault; FALSE if it isn't
+					// part of the address space, or
+					// memory is full
+    int NumPages() { return numPages; }	// Size of the address space
+
+    void SetId(SpaceId id) { spaceId = id; }	// The program's SpaceId, in
+    SpaceId GetId() { return spaceId; }	// the process table; -1 if
+					// it has none
+
+    // Called by the frame table, with its lock held, to pick a page to
+    // evict.
+    bool Referenced(int vpn);		// Has page "vpn" been used since
+					// the last call?
+    bool PageOut(int vpn);		// Evict it, writing it back if need
+					// be; FALSE if it can't be
+
+    // Map the program's file descriptors to entries in the system-wide
+    // open file table (see openfiletable.h).  Descriptors 0 and 1 are
+    // the console's, and never refer to an entry.
+    OpenFileId AddDescriptor(int entry);	// Allocate a descriptor for
+					// "entry"; -1 if none are free
+    int DescriptorEntry(OpenFileId id);	// Entry "id" refers to, -1 if
+					// it isn't in use
+    int RemoveDescriptor(OpenFileId id);	// Free "id", and return the
+					// entry it referred to (-1 if none)
+
   private:
+    SpaceId spaceId;			// Which program this is
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    unsigned int imagePages;		// Number of them holding the
+					// program, rather than mapped files
+    int reservedPages;			// Number of frames reserved for
+					// them (see FrameTable::Reserve)
+    OpenFile *executable;		// The program's file, to read its
+					// pages in from
+    NoffHeader noffH;			// Where its segments are, in the
+					// file and in the address space
+    int numArgs;			// main's arguments: argc ...
+    int argvAddr;			// ... and argv
+    int stackStart;			// Initial stack pointer, below them
+    SortedList<MappedFile *> *mappedFiles; // Files mapped, in order of
+					// address
+    int openFiles[MaxOpenFiles];	// For each descriptor, its entry in
+					// the open file table, -1 if unused
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
+    bool AllocatePage(int vpn);		// Give a page a frame of its own
+    void FreePage(int vpn);		// Take it away again
+    bool ReadIn(int vaddr);		// PageIn, with the frame table
+					// locked
+    bool LoadPage(int vpn);		// Read a page of the program in
+    MappedFile *FindMapped(int vpn);	// Mapped file page "vpn" is in
+    void WriteBack(MappedFile *mapped, int vpn);
+					// Write a page back to its file
+    void Unmap(MappedFile *mapped);	// Write a mapped file back, and
+					// free its pages
 
 };
 
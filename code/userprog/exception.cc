@@ -52,7 +52,7 @@ void ExceptionHandler(ExceptionType which)
 {
 	int type = kernel->machine->ReadRegister(2);
 	int val, size;
-	int status, exit, threadID, programID, fileID, numChar;
+	int status, exit, threadID, programID, fileID, numChar, position;
 	DEBUG(dbgSys, "Received Exception " << which << " type: " << type << "\n");
 	switch (which)
 	{
@@ -69,8 +69,9 @@ void ExceptionHandler(ExceptionType which)
 			DEBUG(dbgSys, "Message received.\n");
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *msg = &(kernel->machine->mainMemory[val]);
-				cout << msg << endl;
+				char msg[MaxStringLength + 1];
+				if (kernel->currentThread->space->CopyInString(val, msg, sizeof(msg)))
+					cout << msg << endl;
 			}
 			SysHalt();
 			ASSERTNOTREACHED();
@@ -80,9 +81,12 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Create:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *filename = &(kernel->machine->mainMemory[val]);
+				char filename[MaxStringLength + 1];
 				//cout << filename << endl;
-				status = SysCreate(filename);
+				if (kernel->currentThread->space->CopyInString(val, filename, sizeof(filename)))
+					status = SysCreate(filename);
+				else
+					status = 0;
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -120,15 +124,50 @@ void ExceptionHandler(ExceptionType which)
 			DEBUG(dbgAddr, "Program exit\n");
 			val = kernel->machine->ReadRegister(4);
 			cout << "return value:" << val << endl;
-			kernel->currentThread->Finish();
+			SysExit(val);
+			ASSERTNOTREACHED();
+			break;
+		case SC_Exec:
+			val = kernel->machine->ReadRegister(4);
+			programID = SysExec(val);
+			kernel->machine->WriteRegister(2, (int)programID);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ExecV:
+			size = kernel->machine->ReadRegister(4);	// argc
+			val = kernel->machine->ReadRegister(5);
+			programID = SysExecV(size, val);
+			kernel->machine->WriteRegister(2, (int)programID);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Join:
+			programID = kernel->machine->ReadRegister(4);
+			status = SysJoin(programID);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
 			break;
 		case SC_Create:
 		val = kernel->machine->ReadRegister(4);
 		size = kernel->machine->ReadRegister(5);
 		{
-		char *filename = &(kernel->machine->mainMemory[val]);
+		char filename[MaxStringLength + 1];
 		//cout << filename << endl;
-		status = SysCreate(filename, size);
+		if (kernel->currentThread->space->CopyInString(val, filename, sizeof(filename)))
+			status = SysCreate(filename, size);
+		else
+			status = 0;
 		kernel->machine->WriteRegister(2, (int) status);
 		}
 		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -140,9 +179,12 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Open:
 		val = kernel->machine->ReadRegister(4);
 		{
-		char *filename = &(kernel->machine->mainMemory[val]);
+		char filename[MaxStringLength + 1];
 		//cout << filename << endl;
-		fileID = SysOpen(filename);
+		if (kernel->currentThread->space->CopyInString(val, filename, sizeof(filename)))
+			fileID = SysOpen(filename);
+		else
+			fileID = -1;
 		kernel->machine->WriteRegister(2, (int) fileID);
 		}
 		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -155,10 +197,9 @@ void ExceptionHandler(ExceptionType which)
 		// DEBUG(dbgTraCode, "In OpenFileId: pos 3."); 
 		val = kernel->machine->ReadRegister(4);
 		{
-		char *buffer = &(kernel->machine->mainMemory[val]);
 		numChar = kernel->machine->ReadRegister(5);
 		fileID = kernel->machine->ReadRegister(6);
-		status = SysRead(buffer, numChar, fileID);
+		status = SysRead(val, numChar, fileID);
 		kernel->machine->WriteRegister(2, (int) status);
 		}
 		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -172,10 +213,9 @@ void ExceptionHandler(ExceptionType which)
 		// DEBUG(dbgTraCode, "In OpenFileId: pos 2."); 
 		val = kernel->machine->ReadRegister(4);
 		{
-		char *buffer = &(kernel->machine->mainMemory[val]);
 		numChar = kernel->machine->ReadRegister(5);
 		fileID = kernel->machine->ReadRegister(6);
-		status = SysWrite(buffer, numChar, fileID);
+		status = SysWrite(val, numChar, fileID);
 		kernel->machine->WriteRegister(2, (int) status);
 		}
 		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -185,6 +225,71 @@ void ExceptionHandler(ExceptionType which)
 		ASSERTNOTREACHED();
 		break;
 
+		case SC_Seek:
+		val = kernel->machine->ReadRegister(4);
+		fileID = kernel->machine->ReadRegister(5);
+		status = SysSeek(val, fileID);
+		kernel->machine->WriteRegister(2, (int) status);
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
+		case SC_PRead:
+		case SC_PWrite:
+		val = kernel->machine->ReadRegister(4);
+		numChar = kernel->machine->ReadRegister(5);
+		position = kernel->machine->ReadRegister(6);
+		fileID = kernel->machine->ReadRegister(7);
+		if (type == SC_PRead)
+			status = SysPRead(val, numChar, position, fileID);
+		else
+			status = SysPWrite(val, numChar, position, fileID);
+		kernel->machine->WriteRegister(2, (int) status);
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
+		case SC_ReadV:
+		case SC_WriteV:
+		val = kernel->machine->ReadRegister(4);
+		size = kernel->machine->ReadRegister(5);	// the number of buffers
+		fileID = kernel->machine->ReadRegister(6);
+		if (type == SC_ReadV)
+			status = SysReadV(val, size, fileID);
+		else
+			status = SysWriteV(val, size, fileID);
+		kernel->machine->WriteRegister(2, (int) status);
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
+		case SC_Mmap:
+		fileID = kernel->machine->ReadRegister(4);
+		size = kernel->machine->ReadRegister(5);
+		status = SysMmap(fileID, size);
+		kernel->machine->WriteRegister(2, (int) status);
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
+		case SC_Munmap:
+		val = kernel->machine->ReadRegister(4);
+		status = SysMunmap(val);
+		kernel->machine->WriteRegister(2, (int) status);
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
 		case SC_Close:
 		fileID = kernel->machine->ReadRegister(4);
 		status = SysClose(fileID);
@@ -195,11 +300,30 @@ void ExceptionHandler(ExceptionType which)
 		return;
 		ASSERTNOTREACHED();
 		break;
+		case SC_Sync:
+		SysSync();
+		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+		return;
+		ASSERTNOTREACHED();
+		break;
 		default:
 			cerr << "Unexpected system call " << type << "\n";
 			break;
 		}
 		break;
+	case PageFaultException:
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		DEBUG(dbgAddr, "Page fault at " << val << "\n");
+		if (kernel->currentThread->space->PageIn(val))
+			return;		// try the instruction again
+		// a bad address, or memory full of pages that can't be
+		// evicted: either way, only this program can't go on
+		cerr << "Bad address " << val << ", or out of memory: killing the program\n";
+		SysExit(-1);
+		ASSERTNOTREACHED();
+		break;
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
@@ -0,0 +1,193 @@
+// frametable.cc
+//	Routines to keep track of the frames of physical memory, and to
+//	take one away from its page when memory is full.  See frametable.h
+//	for an overview.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "frametable.h"
+#include "addrspace.h"
+#include "synch.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// FrameTable::FrameTable
+// 	Initialize a table with every frame free.
+//
+//	"numFrames" -- number of frames of physical memory
+//----------------------------------------------------------------------
+
+FrameTable::FrameTable(int numFrames)
+{
+    ASSERT(numFrames > 0);
+    this->numFrames = numFrames;
+    frames = new Frame[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+        frames[i].space = NULL;
+        frames[i].pinCount = 0;
+    }
+    hand = reserved = 0;
+    lock = new Lock("frame table");
+}
+
+//----------------------------------------------------------------------
+// FrameTable::~FrameTable
+// 	De-allocate the table.
+//----------------------------------------------------------------------
+
+FrameTable::~FrameTable()
+{
+    delete[] frames;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Acquire, FrameTable::Release
+// 	Lock and unlock the table.  It is held while a page fault is
+//	handled, and whenever an address space changes which of its pages
+//	are in memory.
+//----------------------------------------------------------------------
+
+void FrameTable::Acquire()
+{
+    lock->Acquire();
+}
+
+void FrameTable::Release()
+{
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Allocate
+// 	Find a frame to hold page "vpn" of "space": a free one if there is
+//	one, or else one taken away from another page.  Return -1 if every
+//	frame is in use by a page that can't be evicted.
+//
+//	The caller holds the table's lock.
+//----------------------------------------------------------------------
+
+int FrameTable::Allocate(AddrSpace *space, int vpn)
+{
+    int frame = -1;
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    for (int i = 0; i < numFrames; i++)
+        if (frames[i].space == NULL) {
+            frame = i;
+            break;
+        }
+    if (frame == -1)
+        frame = Evict();
+    if (frame == -1)
+        return -1;
+
+    frames[frame].space = space;
+    frames[frame].vpn = vpn;
+    frames[frame].pinCount = 0;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Evict
+// 	Take a frame away from the page in it, and return it; -1 if none
+//	can be.  The clock hand goes round the frames, skipping those that
+//	are pinned, or hold a page that can't be brought back (see
+//	AddrSpace::PageOut).  A page the program has used since the hand
+//	last passed gets a second chance: its use bit is cleared, and it
+//	is only evicted if it hasn't been used again by the hand's next
+//	time round.
+//----------------------------------------------------------------------
+
+int FrameTable::Evict()
+{
+    Frame *victim;
+
+    for (int i = 0; i < 2 * numFrames; i++) {
+        victim = &frames[hand];
+        hand = (hand + 1) % numFrames;
+        if (victim->pinCount > 0)
+            continue;
+        if (victim->space->Referenced(victim->vpn))
+            continue;
+        if (victim->space->PageOut(victim->vpn)) {
+            DEBUG(dbgAddr, "Frame table: evicted frame " << victim - frames);
+            victim->space = NULL;
+            return victim - frames;
+        }
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Free
+// 	Free "frame", once its page no longer needs it.  The caller holds
+//	the table's lock.
+//----------------------------------------------------------------------
+
+void FrameTable::Free(int frame)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(frames[frame].space != NULL && frames[frame].pinCount == 0);
+    frames[frame].space = NULL;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Pin, FrameTable::Unpin
+// 	Keep "frame" from being evicted while the kernel copies to or from
+//	it, and let it go again once it is done.  Pins nest.  Pin is
+//	called with the table's lock held, while the page is known to be
+//	in memory.
+//----------------------------------------------------------------------
+
+void FrameTable::Pin(int frame)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(frames[frame].space != NULL);
+    frames[frame].pinCount++;
+}
+
+void FrameTable::Unpin(int frame)
+{
+    ASSERT(frames[frame].pinCount > 0);
+    frames[frame].pinCount--;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Reserve
+// 	Set aside frames for "pages" pages of a program that can't be
+//	evicted once it changes them.  Return FALSE, setting none aside, if
+//	that would leave fewer than MinEvictableFrames frames for the rest.
+//	Frames aren't given to particular pages: this only keeps count.
+//----------------------------------------------------------------------
+
+bool FrameTable::Reserve(int pages)
+{
+    bool success = FALSE;
+
+    lock->Acquire();
+    if (reserved + pages <= numFrames - MinEvictableFrames) {
+        reserved += pages;
+        success = TRUE;
+    }
+    lock->Release();
+    DEBUG(dbgAddr, "Frame table: " << reserved << " frames reserved");
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Unreserve
+// 	Give back frames set aside by Reserve, once the program exits.
+//----------------------------------------------------------------------
+
+void FrameTable::Unreserve(int pages)
+{
+    lock->Acquire();
+    reserved -= pages;
+    ASSERT(reserved >= 0);
+    lock->Release();
+}
@@ -0,0 +1,90 @@
+// frametable.h
+//	Data structures to keep track of the frames of physical memory,
+//	and which page of which address space each one holds.
+//
+//	When every frame is in use and a program touches a page that
+//	isn't in memory, a frame is taken away from some other page (the
+//	page is "evicted"), chosen with the clock algorithm.  Only a page
+//	that can be brought back later will do: a page of a mapped file,
+//	which is written back to the file first if the program changed it,
+//	or a page of the program that hasn't changed since it was read in
+//	from the executable (or zero-filled).  There is no swap space, so
+//	a page of the program that has changed holds the only copy, and
+//	stays where it is until the program exits.
+//
+//	So that programs can't fill memory with such pages, a program's
+//	writable pages (all but those holding only code or read-only
+//	data) are reserved when it is loaded, and it isn't run if they
+//	don't fit.  MinEvictableFrames frames are never reserved, so that
+//	there is always room to page code and mapped files in and out.
+//
+//	A frame is "pinned" while the kernel is copying to or from it (eg,
+//	for a Read into the program's buffer), so that it isn't taken away
+//	in the middle.
+//
+//	Page faults are handled one at a time, under the table's lock, so
+//	that a page is never read in (or written back) twice at once, and
+//	a frame never changes hands while its old page is being written.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FRAMETABLE_H
+#define FRAMETABLE_H
+
+#include "copyright.h"
+
+class AddrSpace;
+class Lock;
+
+const int MinEvictableFrames = 8; // frames left for pages that can
+                                  // be evicted
+
+// The following class records what one frame holds.
+
+class Frame
+{
+public:
+    AddrSpace *space; // Address space whose page is here, NULL
+                      // if the frame is free
+    int vpn;          // Which of its pages
+    int pinCount;     // Number of kernel transfers using it
+};
+
+// The following class defines the table itself.
+
+class FrameTable
+{
+public:
+    FrameTable(int numFrames); // Initialize a table of free frames
+    ~FrameTable();             // De-allocate the table
+
+    void Acquire(); // Lock the table, to handle a page fault,
+    void Release(); // or change a page table
+
+    int Allocate(AddrSpace *space, int vpn);
+    // Find a frame for page "vpn" of
+    // "space", evicting some other page
+    // if need be; -1 if none can be
+    void Free(int frame); // Done with a frame
+
+    void Pin(int frame);   // The kernel is using the frame
+    void Unpin(int frame); // ... and now it is done
+
+    bool Reserve(int pages);   // Set aside frames for "pages" pages
+                               // that may never be evicted; FALSE if
+                               // they won't fit
+    void Unreserve(int pages); // Done with them
+
+private:
+    int Evict(); // Take a frame away from its page
+
+    int numFrames;  // Number of frames of memory
+    Frame *frames;  // What each one holds
+    int hand;       // Position of the clock hand
+    int reserved;   // Number of frames set aside by Reserve
+    Lock *lock;     // One page fault at a time
+};
+
+#endif // FRAMETABLE_H
@@ -14,9 +14,11 @@
 #include "kernel.h"
 
 #include "synchconsole.h"
+#include "processtable.h"
 
 void SysHalt()
 {
+	kernel->fileSystem->Sync();
 	kernel->interrupt->Halt();
 }
 
@@ -25,6 +27,66 @@ int SysAdd(int op1, int op2)
 	return op1 + op2;
 }
 
+// A user program's SpaceId is kept in its address space (see
+// Kernel::ExecV)
+
+void SysExit(int status)
+{
+	SpaceId id = kernel->currentThread->space->GetId();
+
+	// write back its mapped files, close its open ones, and free its
+	// memory
+	delete kernel->currentThread->space;
+	kernel->currentThread->space = NULL;
+	if (kernel->processTable->Exit(id, status))
+		kernel->fileSystem->Sync(); // the last program: make it all stick
+	kernel->currentThread->Finish();
+}
+
+// Exec and ExecV copy the program's name and arguments in, for the
+// new program to get on its stack
+
+SpaceId SysExec(int nameAddr)
+{
+	char name[MaxStringLength + 1];
+	char *argv[1] = { name };
+
+	if (!kernel->currentThread->space->CopyInString(nameAddr, name, sizeof(name))) {
+		return -1;
+	}
+	return kernel->ExecV(1, argv, kernel->currentThread->space->GetId());
+}
+
+SpaceId SysExecV(int argc, int argvAddr)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int addrs[MaxArgs], length = argc * sizeof(int);
+	char *argv[MaxArgs];
+	SpaceId id = -1;
+	bool valid = TRUE;
+	int n;
+
+	if (argc < 1 || argc > MaxArgs || space->CopyIn(argvAddr, (char *) addrs, length) != length) {
+		return -1;
+	}
+	for (n = 0; n < argc && valid; n++) {
+		argv[n] = new char[MaxStringLength + 1];
+		valid = space->CopyInString(WordToHost(addrs[n]), argv[n], MaxStringLength + 1);
+	}
+	if (valid) {
+		id = kernel->ExecV(argc, argv, space->GetId());
+	}
+	for (int i = 0; i < n; i++) {
+		delete [] argv[i];
+	}
+	return id;
+}
+
+int SysJoin(SpaceId id)
+{
+	return kernel->processTable->Join(id, kernel->currentThread->space->GetId());
+}
+
 #ifdef FILESYS_STUB
 int SysCreate(char *filename)
 {
@@ -40,25 +102,207 @@ int SysCreate(char *name, int size){
 	return 1;
 }
 
+// Files are named by descriptors, which the address space maps to
+// entries in the file system's open file table; descriptors 0 and 1
+// are the console.
+
 OpenFileId SysOpen(char* name){
-	OpenFile *file = kernel->fileSystem->Open(name);
-	if(file==NULL){
-		return 0;
+	AddrSpace *space = kernel->currentThread->space;
+	int entry = kernel->fileSystem->OpenAFile(name);
+	OpenFileId id;
+
+	if(entry==-1){
+		return -1;
 	}
-	return 1;
+	id = space->AddDescriptor(entry);
+	if(id==-1){
+		kernel->fileSystem->CloseFile(entry); // out of descriptors
+	}
+	return id;
+}
+
+// Read and Write move data straight between the file (or console) and
+// the program's memory, with no copy in between.  The program's buffers
+// are broken into runs of memory that are contiguous in physical memory
+// (see AddrSpace::UserRun), and the file system transfers them all in
+// one operation.  A transfer stops at the first page of a buffer that
+// isn't valid.  The runs' frames are pinned (see frametable.h) until
+// the transfer is done.
+
+// Find the runs that "count" buffers, at "addrs" and "sizes" long, are
+// made of; return how many there are, in "runs" and "runSizes" (which
+// the caller deletes).
+static int UserRuns(int *addrs, int *sizes, int count, bool writing,
+		char ***runs, int **runSizes){
+	AddrSpace *space = kernel->currentThread->space;
+	int maxRuns = 0, numRuns = 0, done, length;
+	char *run;
+
+	for(int i=0; i<count; i++){ // a run per page at worst, and a buffer
+		// can't cover more pages than the address space has
+		maxRuns += min(sizes[i]/PageSize + 2, space->NumPages());
+	}
+	*runs = new char *[maxRuns];
+	*runSizes = new int[maxRuns];
+	for(int i=0; i<count; i++){
+		for(done=0; done<sizes[i]; done+=length){
+			run = space->UserRun(addrs[i]+done, sizes[i]-done, writing, &length);
+			if(run==NULL){
+				return numRuns;
+			}
+			ASSERT(numRuns < maxRuns);
+			(*runs)[numRuns] = run;
+			(*runSizes)[numRuns++] = length;
+		}
+	}
+	return numRuns;
+}
+
+// Read a line from the console into "runs"
+static int ConsoleRead(char **runs, int *runSizes, int numRuns){
+	int done = 0;
+	for(int i=0; i<numRuns; i++){
+		for(int n=0; n<runSizes[i]; n++){
+			char ch = kernel->synchConsoleIn->GetChar();
+			if(ch==EOF){
+				return done;
+			}
+			runs[i][n] = ch;
+			done++;
+			if(ch=='\n'){
+				return done;
+			}
+		}
+	}
+	return done;
 }
 
-int SysRead(char *buf, int size, OpenFileId id){
-	return kernel->fileSystem->ReadFile(buf, size, id);
+// Transfer "count" buffers to/from "id" (for Read and Write, one buffer),
+// at "position", or where the last transfer left off if it is -1.
+// Return the number of bytes transferred, or -1 if "id" is not open for
+// it, or the first buffer isn't valid.
+static int Transfer(int *addrs, int *sizes, int count, int position,
+		OpenFileId id, bool writing){
+	int entry = kernel->currentThread->space->DescriptorEntry(id);
+	int numRuns, result;
+	bool empty = TRUE;
+	char **runs;
+	int *runSizes;
+
+	for(int i=0; i<count; i++){
+		if(sizes[i]<0){
+			return -1;
+		}
+		empty = empty && sizes[i]==0;
+	}
+	if(position!=-1 && (id==SysConsoleInput || id==SysConsoleOutput)){
+		return -1; // the console has no positions
+	}
+	numRuns = UserRuns(addrs, sizes, count, !writing, &runs, &runSizes);
+	if(numRuns==0 && !empty){
+		result = -1; // bad buffer
+	} else if(!writing && id==SysConsoleInput){
+		result = ConsoleRead(runs, runSizes, numRuns);
+	} else if(writing && id==SysConsoleOutput){
+		result = 0;
+		for(int i=0; i<numRuns; i++){
+			for(int n=0; n<runSizes[i]; n++){
+				kernel->synchConsoleOut->PutChar(runs[i][n]);
+			}
+			result += runSizes[i];
+		}
+	} else if(position==-1){
+		result = writing ?
+			kernel->fileSystem->WriteFileV(runs, runSizes, numRuns, entry) :
+			kernel->fileSystem->ReadFileV(runs, runSizes, numRuns, entry);
+	} else {
+		result = writing ?
+			kernel->fileSystem->WriteFileVAt(runs, runSizes, numRuns, position, entry) :
+			kernel->fileSystem->ReadFileVAt(runs, runSizes, numRuns, position, entry);
+	}
+	for(int i=0; i<numRuns; i++){ // unpin them
+		kernel->currentThread->space->ReleaseRun(runs[i], runSizes[i]);
+	}
+	delete [] runs;
+	delete [] runSizes;
+	return result;
+}
+
+int SysRead(int addr, int size, OpenFileId id){
+	return Transfer(&addr, &size, 1, -1, id, FALSE);
+}
+
+int SysWrite(int addr, int size, OpenFileId id){
+	return Transfer(&addr, &size, 1, -1, id, TRUE);
 }
 
-int SysWrite(char *buf, int size, OpenFileId id){
-	return kernel->fileSystem->WriteFile(buf, size, id);
+int SysPRead(int addr, int size, int position, OpenFileId id){
+	if(position<0){
+		return -1;
+	}
+	return Transfer(&addr, &size, 1, position, id, FALSE);
+}
+
+int SysPWrite(int addr, int size, int position, OpenFileId id){
+	if(position<0){
+		return -1;
+	}
+	return Transfer(&addr, &size, 1, position, id, TRUE);
+}
+
+// ReadV and WriteV: the program's IoVec array, two words per buffer,
+// is copied in at once
+static int TransferV(int iovAddr, int count, OpenFileId id, bool writing){
+	int iov[2 * MaxIoVecs], addrs[MaxIoVecs], sizes[MaxIoVecs];
+	int length = count * 2 * sizeof(int);
+
+	if(count<0 || count>MaxIoVecs ||
+			kernel->currentThread->space->CopyIn(iovAddr, (char *) iov, length)!=length){
+		return -1;
+	}
+	for(int i=0; i<count; i++){
+		addrs[i] = WordToHost(iov[2*i]);
+		sizes[i] = WordToHost(iov[2*i+1]);
+	}
+	return Transfer(addrs, sizes, count, -1, id, writing);
+}
+
+int SysReadV(int iovAddr, int count, OpenFileId id){
+	return TransferV(iovAddr, count, id, FALSE);
+}
+
+int SysWriteV(int iovAddr, int count, OpenFileId id){
+	return TransferV(iovAddr, count, id, TRUE);
+}
+
+// Mapped files are demand paged: see AddrSpace::Mmap
+
+int SysMmap(OpenFileId id, int length){
+	int addr = kernel->currentThread->space->Mmap(id, length);
+
+	return (addr==-1) ? 0 : addr; // NULL, to the program
+}
+
+int SysMunmap(int addr){
+	return kernel->currentThread->space->Munmap(addr) ? 1 : -1;
+}
+
+int SysSeek(int position, OpenFileId id){
+	return kernel->fileSystem->SeekFile(position,
+			kernel->currentThread->space->DescriptorEntry(id));
 }
 
 int SysClose(OpenFileId id){
-	kernel->fileSystem->CloseFile(id);
-	return 1;
+	int entry = kernel->currentThread->space->RemoveDescriptor(id);
+
+	if(entry==-1){
+		return -1;
+	}
+	return kernel->fileSystem->CloseFile(entry);
+}
+
+void SysSync(){
+	kernel->fileSystem->Sync();
 }
 
 
@@ -0,0 +1,156 @@
+// processtable.cc
+//	Routines to keep track of the user programs running, so that they
+//	can be joined.  See processtable.h for an overview.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "processtable.h"
+#include "synch.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// ProcessTable::ProcessTable
+// 	Initialize a table with no programs in it.
+//
+//	"numProcesses" -- number of programs that can run at once
+//----------------------------------------------------------------------
+
+ProcessTable::ProcessTable(int numProcesses)
+{
+    ASSERT(numProcesses > 0);
+    this->numProcesses = numProcesses;
+    processes = new Process[numProcesses];
+    for (int i = 0; i < numProcesses; i++)
+        processes[i].inUse = FALSE;
+    numRunning = 0;
+    lock = new Lock("process table");
+    exited = new Condition("process exited");
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::~ProcessTable
+// 	De-allocate the table.
+//----------------------------------------------------------------------
+
+ProcessTable::~ProcessTable()
+{
+    delete[] processes;
+    delete lock;
+    delete exited;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Get
+// 	Return the entry for "id", or NULL if it isn't in use.  "id" may
+//	come from a user program, so it may be anything at all.
+//----------------------------------------------------------------------
+
+Process *ProcessTable::Get(SpaceId id)
+{
+    if (id < 1 || id > numProcesses || !processes[id - 1].inUse)
+        return NULL;
+    return &processes[id - 1];
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Free
+// 	Free an entry, once nobody can need its exit status any more.
+//----------------------------------------------------------------------
+
+void ProcessTable::Free(Process *process)
+{
+    DEBUG(dbgAddr, "Process table: entry " << process - processes + 1 << " freed");
+    process->inUse = FALSE;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Add
+// 	Enter a program that is about to start.  Return its SpaceId, or -1
+//	if the table is full.
+//
+//	"parent" -- the program starting it, -1 if none
+//----------------------------------------------------------------------
+
+SpaceId ProcessTable::Add(SpaceId parent)
+{
+    SpaceId id = -1;
+
+    lock->Acquire();
+    for (int i = 0; i < numProcesses; i++)
+        if (!processes[i].inUse)
+        {
+            processes[i].inUse = TRUE;
+            processes[i].parent = parent;
+            processes[i].exited = FALSE;
+            id = i + 1;
+            numRunning++;
+            break;
+        }
+    lock->Release();
+    DEBUG(dbgAddr, "Process table: entry " << id << " started by " << parent);
+    return id;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Exit
+// 	Note that "id" has exited with "status", and wake up its parent if
+//	it is waiting in Join.  Programs it started can no longer be
+//	joined, so any of them that have exited are done with.  Return
+//	TRUE if no other program is still running.
+//----------------------------------------------------------------------
+
+bool ProcessTable::Exit(SpaceId id, int status)
+{
+    Process *process;
+    bool last;
+
+    lock->Acquire();
+    process = Get(id);
+    ASSERT(process != NULL && !process->exited);
+    process->exited = TRUE;
+    process->exitStatus = status;
+    last = (--numRunning == 0);
+    for (int i = 0; i < numProcesses; i++)
+        if (processes[i].inUse && processes[i].parent == id)
+        {
+            processes[i].parent = -1;
+            if (processes[i].exited)
+                Free(&processes[i]);
+        }
+    if (process->parent == -1)
+        Free(process);
+    else
+        exited->Broadcast(lock);
+    lock->Release();
+    return last;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Join
+// 	Wait for "id" to exit, and return its exit status; its entry is
+//	then done with.  Return -1 if "id" wasn't started by "parent" (or
+//	has been joined already).
+//----------------------------------------------------------------------
+
+int ProcessTable::Join(SpaceId id, SpaceId parent)
+{
+    Process *process;
+    int status;
+
+    lock->Acquire();
+    process = Get(id);
+    if (process == NULL || process->parent != parent)
+    {
+        lock->Release();
+        return -1;
+    }
+    while (!process->exited)
+        exited->Wait(lock);
+    status = process->exitStatus;
+    Free(process);
+    lock->Release();
+    return status;
+}
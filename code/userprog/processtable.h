@@ -0,0 +1,71 @@
+// processtable.h
+//	Data structures for the table of user programs running.
+//
+//	A running user program (a "process") is named by a small integer,
+//	its SpaceId, which Exec and ExecV return.  The program that
+//	started it may Join it, to wait for it to finish and get its exit
+//	status.  So each entry of this table holds who started the
+//	program, and once it has exited, its status, until it is joined.
+//
+//	An entry is freed once the program has exited and been joined, or
+//	once it has exited and nobody can join it any more: it was started
+//	from the command line, or the program that started it has exited
+//	too.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PROCESSTABLE_H
+#define PROCESSTABLE_H
+
+#include "copyright.h"
+#include "syscall.h"
+
+class Lock;
+class Condition;
+
+const int ProcessTableSize = 64; // user programs running at once
+
+// The following class defines one entry of the table.
+
+class Process
+{
+public:
+    bool inUse;     // Is the entry in use?
+    SpaceId parent; // The program that may Join it; -1 if none
+    bool exited;    // Has it exited yet?
+    int exitStatus; // If so, what it passed to Exit
+};
+
+// The following class defines the table itself.
+
+class ProcessTable
+{
+public:
+    ProcessTable(int numProcesses); // Initialize an empty table
+    ~ProcessTable();                // De-allocate the table
+
+    SpaceId Add(SpaceId parent);       // Enter a new program, started
+                                       // by "parent"; return its
+                                       // SpaceId, or -1 if the table
+                                       // is full
+    bool Exit(SpaceId id, int status); // "id" has exited; TRUE if it
+                                       // was the last one running
+    int Join(SpaceId id, SpaceId parent); // Wait for "id" to exit, and
+                                          // return its status; -1 if
+                                          // "parent" didn't start it
+
+private:
+    Process *Get(SpaceId id); // The entry for "id", NULL if none
+    void Free(Process *process); // Done with an entry
+
+    int numProcesses;    // Number of entries in the table
+    Process *processes;  // The entries themselves; entry i is
+                         // for SpaceId i + 1
+    int numRunning;      // Number of programs not yet exited
+    Lock *lock;          // Protects the table
+    Condition *exited;   // Signalled when any program exits
+};
+
+#endif // PROCESSTABLE_H
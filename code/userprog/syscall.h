@@ -34,6 +34,13 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_Sync         16
+#define SC_PRead        17
+#define SC_PWrite       18
+#define SC_ReadV        19
+#define SC_WriteV       20
+#define SC_Mmap         21
+#define SC_Munmap       22
 #define SC_Add		42
 #define SC_MSG		100
 
@@ -80,12 +87,15 @@ SpaceId Exec(char* exec_name);
 
 /* Run the executable, stored in the Nachos file "argv[0]", with
  * parameters stored in argv[1..argc-1] and return the 
- * address space identifier
+ * address space identifier, or -1 if it could not be started.
+ * The program's main is called as main(argc, argv); at most
+ * 16 arguments are passed.
  */
 SpaceId ExecV(int argc, char* argv[]);
  
 /* Only return once the user program "id" has finished.  
- * Return the exit status.
+ * Return the exit status, or -1 if "id" was not started by the caller
+ * (or has already been joined).
  */
 int Join(SpaceId id); 	
  
@@ -122,7 +132,8 @@ int Create(char *name, int size); // FILE_SYS
 int Remove(char *name);
 
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
- * be used to read and write to the file.
+ * be used to read and write to the file.  Return -1 if the file does
+ * not exist, or too many files are open.
  */
 OpenFileId Open(char *name);
 
@@ -140,8 +151,46 @@ int Write(char *buffer, int size, OpenFileId id);
  */
 int Read(char *buffer, int size, OpenFileId id);
 
+/* Like Read and Write, but at byte "position" of the open file,
+ * rather than where the last Read or Write left off (which they don't
+ * change).  Saves a Seek for each record of a file read or written
+ * out of order.  Return -1 for the console, which has no positions.
+ */
+int PRead(char *buffer, int size, int position, OpenFileId id);
+int PWrite(char *buffer, int size, int position, OpenFileId id);
+
+/* One of the buffers for ReadV and WriteV */
+typedef struct {
+    char *buffer;
+    int size;
+} IoVec;
+
+#define MaxIoVecs	16	/* most buffers ReadV and WriteV take */
+
+/* Like Read and Write, but into or out of "count" buffers, one after
+ * another, in a single call: eg, a record's header and its data.
+ * Nobody else sees the file part way through.
+ */
+int ReadV(IoVec *iov, int count, OpenFileId id);
+int WriteV(IoVec *iov, int count, OpenFileId id);
+
+/* Map the first "length" bytes of the open file "id" into memory, and
+ * return the address they start at; NULL on failure.  Reading or
+ * writing there reads or writes the file, without copying it in or out
+ * with Read and Write.  If the file is shorter, the rest reads as zeros,
+ * and the file grows if it is written.  Changes reach the file when it
+ * is unmapped, or the program exits.  Closing "id" doesn't unmap it.
+ */
+char *Mmap(OpenFileId id, int length);
+
+/* Unmap the file mapped at "addr".
+ * Return 1 on success, negative error code on failure
+ */
+int Munmap(char *addr);
+
 /* Set the seek position of the open file "id"
  * to the byte "position".
+ * Return 1 on success, negative error code on failure
  */
 int Seek(int position, OpenFileId id);
 
@@ -150,6 +199,12 @@ int Seek(int position, OpenFileId id);
  */
 int Close(OpenFileId id);
 
+/* Make every change to the file system so far survive a crash.
+ * Changes are otherwise committed in groups, some time after they
+ * are made.
+ */
+void Sync();
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 